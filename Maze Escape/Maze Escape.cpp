@@ -16,8 +16,15 @@
 #include <iostream>
 #include <fstream>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <vector>
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
 #include <Windows.h>
 
 const char SPACE = ' ';
@@ -29,9 +36,11 @@ const char TREASURE = 'X';
 const char PLAYER = '@';
 const char ENEMY = 'E';
 
-const char VISITED = 'V';
-
 const char QUIT = 'q';
+const char MINIMAP = 'm';
+
+const int DIRECTIONS_COUNT = 4;
+const int DIRECTIONS[DIRECTIONS_COUNT][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
 
 const char UP = 'w';
 const char DOWN = 's';
@@ -44,10 +53,71 @@ const int DEFAULT_LIVES = 3;
 const int NAME_MIN_LENGTH = 2;
 const int NAME_MAX_LENGTH = 51;
 const int LIFE_PRICE = 30;
-
-const int GREEN_COLOR = 2;
-const int RED_COLOR = 4;
-const int WHITE_COLOR = 7;
+const int LEADERBOARD_PAGE_SIZE = 10;
+
+const int BITS_PER_WORD = 64;
+
+const int RANK_KEY_LEVEL_BITS = 4;
+const int RANK_KEY_COINS_BITS = 24;
+const int RANK_KEY_LIVES_BITS = 16;
+const int RANK_KEY_SLOT_BITS = 20;
+const int RADIX_BITS = 8;
+
+const char VALIDATE_PLAYERS_OPTION[] = "--validate-players";
+const char CONVERT_MAPS_OPTION[] = "--convert-maps";
+
+const size_t JOURNAL_COMPACT_SIZE = 64 * 1024;
+
+const unsigned int FNV_OFFSET_BASIS = 2166136261u;
+const unsigned int FNV_PRIME = 16777619u;
+
+const char MAP_FILE_SIGNATURE[] = "MZMP";
+const int MAP_FILE_VERSION = 1;
+
+// Maps whose next hop table (one byte per pair of open cells) fits in this many bytes get one
+const size_t NEXT_HOP_TABLE_BUDGET = 4 * 1024 * 1024;
+const size_t NEXT_HOP_TARGETS_PER_WORKER = 256;
+const unsigned char NO_NEXT_HOP = 0xFF;
+// Side of the square clusters a large map is cut into for the hierarchical search
+const int CLUSTER_SIZE = 16;
+// Border runs at least this long get an entrance at each end instead of one in the middle
+const int ENTRANCE_SPLIT_LENGTH = 6;
+// A player this close is chased with an exact search, cut off at this path length
+const int LOCAL_SEARCH_MAX_COST = 4 * CLUSTER_SIZE;
+const size_t CLUSTER_GRAPH_MIN_CELLS = 256 * 256;
+// How much longer than the old end of its route the enemy looks for a player who left the route's last cluster
+const int ROUTE_PATCH_SLACK = 2 * CLUSTER_SIZE;
+// A patched route may wander this much further from the player than its last full plan did
+const int ROUTE_MAX_EXTRA_DETOUR = 4 * CLUSTER_SIZE;
+const size_t CLUSTERS_PER_WORKER = 64;
+
+const size_t MAP_ARENA_BLOCK_SIZE = 256 * 1024;
+const size_t MAP_ARENA_ALIGNMENT = 16;
+
+const char PLAYER_STORE_SIGNATURE[] = "MZPS";
+const int PLAYER_STORE_VERSION = 1;
+const int PLAYER_STORE_MIN_INDEX_SLOTS = 64;
+const int EMPTY_INDEX_SLOT = -1;
+
+// ANSI foreground colors, the default one resets all attributes
+const char DEFAULT_COLOR = 0;
+const char GREEN_COLOR = 32;
+const char RED_COLOR = 31;
+
+const int FRAME_TEXT_WIDTH = 48;
+const int DEFAULT_CONSOLE_ROWS = 30;
+const int DEFAULT_CONSOLE_COLS = 120;
+const int MOVE_RULES_COUNT = 7;
+const char* const MOVE_RULES[MOVE_RULES_COUNT] =
+{
+    "Press one of the keys below:",
+    "W - Up",
+    "S - Down",
+    "A - Left",
+    "D - Right",
+    "M - Show or hide the minimap",
+    "Q - Quit the level saving the progress"
+};
 
 enum MoveResult
 {
@@ -62,29 +132,211 @@ enum MoveResult
     ENEMY_ENCOUNTER
 };
 
+// Each record is its type followed by its int fields, a move record also has the move before them.
+// A journal starts with a checkpoint record holding the checksum of the player file it continues.
+enum JournalRecordType
+{
+    JOURNAL_CHECKPOINT,
+    JOURNAL_PLAYER_STATS,
+    JOURNAL_GAME_STARTED,
+    JOURNAL_GAME_RESUMED,
+    JOURNAL_MOVE,
+    JOURNAL_GAME_ENDED
+};
+
+// How the enemy searches for the player on maps too large for a next hop table
+enum PathSearch
+{
+    SEARCH_DISTANCE_FIELD,
+    SEARCH_A_STAR,
+    SEARCH_JUMP_POINTS
+};
+
+enum GameOutcome
+{
+    GAME_IN_PROGRESS,
+    GAME_WON,
+    GAME_LOST
+};
+
 struct MapCoordinate
 {
     size_t rowIdx;
     size_t colIdx;
 };
 
-struct VisitedCell
+struct MapPaths;
+
+struct PortalSlot
 {
-    char originalContent;
-    int steps;
-    int parentIndex;
-    MapCoordinate coordinate;
+    int cellIdx;
+    int portalIdx;
 };
 
+// A map owns its tiles unless sharesTiles is set, so it can be moved but not copied
 struct Map
 {
     int rowsCount;
     int colsCount;
+    int stride;
     int portalsCount;
-    char** matrix;
+    char* matrix = nullptr;
     MapCoordinate playerPosition;
     MapCoordinate enemyPosition;
-    MapCoordinate* portals;
+    MapCoordinate* portals = nullptr;
+    // Open addressing table from a portal's cell index to its position in portals
+    PortalSlot* portalSlots = nullptr;
+    int portalSlotsCount;
+    // Cells of the coins and the key in increasing order, a collectible is numbered by its place here
+    int* collectibleCells = nullptr;
+    int collectiblesCount = 0;
+    // Set when the tiles belong to a catalog arena or to the template the game was started from,
+    // such a map only keeps its own cleared tiles
+    bool sharesTiles = false;
+    // The search data of a catalog map, shared read-only by the games started from it
+    const MapPaths* paths = nullptr;
+    // One bit per collectible, set once it is picked up
+    std::vector<unsigned long long> clearedTiles;
+
+    Map() = default;
+    Map(const Map&) = delete;
+    Map& operator=(const Map&) = delete;
+    Map(Map&& other) noexcept;
+    Map& operator=(Map&& other) noexcept;
+    ~Map();
+};
+
+// Bump allocator for the maps of one catalog level, its blocks are all freed when it is destroyed
+struct MapArena
+{
+    std::vector<char*> blocks;
+    size_t blockSize = 0;
+    size_t blockUsed = 0;
+
+    MapArena() = default;
+    MapArena(const MapArena&) = delete;
+    MapArena& operator=(const MapArena&) = delete;
+    ~MapArena();
+};
+
+// The player store is this header, an open addressing index of record numbers keyed on the
+// case-folded name and then the fixed size records, one per player in sign-up order
+struct PlayerStoreHeader
+{
+    char signature[4];
+    int version;
+    int recordsCount;
+    int indexSlotsCount;
+};
+
+// Binary map file: the header, portalsCount (row, col) pairs and rowsCount * colsCount tiles.
+// The player and enemy tiles are stored as spaces, their positions are in the header.
+struct MapFileHeader
+{
+    char signature[4];
+    int version;
+    int rowsCount;
+    int colsCount;
+    int portalsCount;
+    int coinsCount;
+    int playerRow;
+    int playerCol;
+    int enemyRow;
+    int enemyCol;
+};
+
+struct SearchNode
+{
+    int priority;
+    int cost;
+    int cellIdx;
+};
+
+struct PassabilityBitmap
+{
+    std::vector<unsigned long long> passable;
+};
+
+struct DistanceField
+{
+    int rootIdx = -1;
+    size_t repairCost = 0;
+    std::vector<int> distances;
+};
+
+// The enemy's first step from every open cell towards every open cell. Open cells are numbered
+// densely, the row of a target holds the direction index to take from each source.
+struct NextHopTable
+{
+    std::vector<int> openCells;
+    std::vector<int> openNumbers;
+    std::vector<unsigned char> directions;
+};
+
+// Maps too large for a next hop table are cut into square clusters. Every open run along a cluster
+// border gets an entrance on both sides, entrances of one cluster are linked by their distances
+// inside it and entrances facing each other across a border by a single step.
+struct ClusterGraph
+{
+    int clusterRowsCount = 0;
+    int clusterColsCount = 0;
+    // The entrances of cluster c are numbered from entranceOffsets[c] to entranceOffsets[c + 1]
+    std::vector<int> entranceOffsets;
+    std::vector<int> entranceCells;
+    // A matrix of distances between the entrances of each cluster, -1 when one can't reach the other
+    std::vector<int> distanceOffsets;
+    std::vector<int> distances;
+    std::vector<int> crossingOffsets;
+    std::vector<int> crossingTargets;
+};
+
+// The cells of the enemy's last route, from where it stands (start) to where the player was
+struct EnemyRoute
+{
+    std::vector<int> cells;
+    size_t start = 0;
+    // Routes planned over the cluster graph are only close to shortest
+    bool isShortest = true;
+    // How much longer than the Manhattan distance the route was when it was last planned in full
+    int plannedDetour = 0;
+    size_t hits = 0;
+    size_t misses = 0;
+};
+
+// What the enemy's searches need to know about a map's walls. Walls never change during a game, so all of
+// it is built once per map: catalog maps build it when they are loaded and every game started from them
+// reads the same copy, and a route or a table built from it stays valid for the whole game.
+struct MapPaths
+{
+    PassabilityBitmap passability;
+    // Label of the wall-connected region of every open cell, -1 for walls. The enemy can't use
+    // portals, so it reaches exactly the cells with its own label.
+    std::vector<int> components;
+    NextHopTable nextHops;
+    ClusterGraph clusterGraph;
+};
+
+struct PathFinder
+{
+    unsigned int generation = 0;
+    std::vector<unsigned int> visitedGenerations;
+    std::vector<int> parents;
+    std::vector<int> costs;
+    std::vector<int> frontier;
+    std::vector<SearchNode> openNodes;
+    std::vector<int> jumpPoints;
+    // The map's shared search data, or ownPaths for a map that isn't in the catalog
+    const MapPaths* paths = nullptr;
+    MapPaths ownPaths;
+    // Floods of one cluster, from the player and from the cell the enemy's route is refined from
+    std::vector<int> goalDistances;
+    std::vector<int> clusterDistances;
+    std::vector<int> clusterFrontier;
+    // The enemy, the entrances on its abstract path and the player
+    std::vector<int> waypoints;
+    PathSearch search = SEARCH_DISTANCE_FIELD;
+    DistanceField distanceField;
+    EnemyRoute route;
 };
 
 struct Game
@@ -93,16 +345,148 @@ struct Game
     int coinsCollected = 0;
     int totalCoins;
     int level;
+    // Fingerprint of the catalog map the game was started from, 0 for maps read from a player file
+    unsigned int mapId = 0;
     Map map;
 };
 
+struct MoveRecord
+{
+    MoveResult result;
+    MapCoordinate playerPosition;
+    MapCoordinate enemyPosition;
+};
+
+struct GameEngine
+{
+    Game* game = nullptr;
+    int lives = 0;
+    int enemyStepsPerMove = 1;
+    GameOutcome outcome = GAME_IN_PROGRESS;
+    PathFinder pathFinder;
+};
+
+// The part of the map shown on screen. Every shown cell stands for a block of tiles,
+// which is bigger than one tile only on the minimap.
+struct Viewport
+{
+    int firstRow = 0;
+    int firstCol = 0;
+    int rowsCount = 0;
+    int colsCount = 0;
+    int blockRows = 1;
+    int blockCols = 1;
+};
+
+// Characters and colors of the screen, row by row
+struct Frame
+{
+    int rowsCount = 0;
+    int colsCount = 0;
+    std::vector<char> chars;
+    std::vector<char> colors;
+};
+
+// Keeps the frame currently on the console, so a new frame only redraws the cells that changed
+struct FrameRenderer
+{
+    Frame shownFrame;
+    Frame nextFrame;
+    std::vector<char> output;
+};
+
 struct Player
 {
     char name[NAME_MAX_LENGTH];
     int level = 1;
     int lives = DEFAULT_LIVES;
     int coins = 0;
+    int leaderboardSlot = -1;
     Game savedGamesPerLevel[MAX_LEVEL] = {};
+    // Journal records not written yet and the size of the journal file after the last checkpoint
+    std::vector<char> pendingJournal;
+    size_t journalSize = 0;
+};
+
+struct LeaderboardEntry
+{
+    char name[NAME_MAX_LENGTH];
+    int level;
+    int coins;
+    int lives;
+};
+
+struct RankNode
+{
+    int priority = 0;
+    int size = 1;
+    int left = -1;
+    int right = -1;
+};
+
+// Order statistics treap over the leaderboard entries, node i holds the entry in slot i.
+// The treap orders the packed rank keys, so the entries are read only for printed rows
+struct Leaderboard
+{
+    std::vector<LeaderboardEntry> entries;
+    std::vector<unsigned long long> keys;
+    std::vector<RankNode> nodes;
+    int root = -1;
+};
+
+// Case-folded names of all players, name i is the one in store slot i, and an open addressing
+// index of their slots, so a name is found without touching the store
+struct PlayerIndex
+{
+    std::vector<char> foldedNames;
+    std::vector<int> indexSlots;
+    int playersCount = 0;
+};
+
+enum ValidationIssue
+{
+    NO_ISSUES = 0,
+    UNREADABLE_FILE = 1 << 0,
+    INVALID_PLAYER_STATS = 1 << 1,
+    CORRUPT_SAVED_GAME = 1 << 2,
+    LEVEL_NOT_UNLOCKED = 1 << 3,
+    UNKNOWN_MAP = 1 << 4,
+    INVALID_POSITIONS = 1 << 5,
+    COINS_MISMATCH = 1 << 6,
+    KEY_MISMATCH = 1 << 7,
+    CORRUPT_JOURNAL = 1 << 8,
+    ENEMY_PATH_NOT_SHORTEST = 1 << 9
+};
+
+const int VALIDATION_ISSUES_COUNT = 10;
+
+struct PlayerValidation
+{
+    char fileName[MAX_PATH];
+    int playerIssues = NO_ISSUES;
+    int gameIssues[MAX_LEVEL] = {};
+};
+
+struct WorkQueue
+{
+    std::mutex mutex;
+    std::deque<size_t> jobs;
+};
+
+struct MapCatalog
+{
+    std::vector<Game> levelMaps[MAX_LEVEL];
+    MapArena levelArenas[MAX_LEVEL];
+    // A deque keeps the addresses the maps point to while more are added
+    std::deque<MapPaths> levelPaths[MAX_LEVEL];
+};
+
+struct ValidationBatch
+{
+    MapCatalog catalog;
+    std::vector<PlayerValidation> results;
+    WorkQueue* queues = nullptr;
+    size_t workersCount = 0;
 };
 
 char toLower(char ch)
@@ -145,11 +529,6 @@ int strCompare(const char* str1, const char* str2)
     }
 }
 
-bool isValidIdx(int idx, size_t arrLen)
-{
-    return idx >= 0 && idx < arrLen;
-}
-
 void clearConsole()
 {
     std::cout << "\033[;H"; // Moves cursor to the top left
@@ -157,17 +536,16 @@ void clearConsole()
     std::cout << "\033[3J"; // Clears the scrollback buffer
 }
 
-void setConsoleColor(int colorNumber)
+// The console renders the ANSI sequences used by clearConsole and the game frames
+void enableVirtualTerminal()
 {
     HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
-    SetConsoleTextAttribute(hConsole, colorNumber);
-}
+    DWORD mode = 0;
 
-void printCharWithColorAndReset(char ch, int color)
-{
-    setConsoleColor(color);
-    std::cout << ch;
-    setConsoleColor(WHITE_COLOR);
+    if (GetConsoleMode(hConsole, &mode))
+    {
+        SetConsoleMode(hConsole, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+    }
 }
 
 bool isInRange(int value, int from, int to)
@@ -310,6 +688,71 @@ bool fileExists(const char* name)
     return false;
 }
 
+char* getTempFilePath(const char* filePath)
+{
+    const char* folders[] = { filePath };
+    return getFilePath(folders, 1, "tmp");
+}
+
+// Makes the file's cached writes durable, a file written through a stream is only flushed to the OS cache
+bool flushFileToDisk(const char* filePath)
+{
+    HANDLE file = CreateFileA(filePath, GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    bool isFlushed = FlushFileBuffers(file) != 0;
+    CloseHandle(file);
+
+    return isFlushed;
+}
+
+// Flushes a fully written temp file and renames it over the target, so a crash leaves either
+// the old or the new contents and never a partly written file
+bool commitTempFile(const char* tempFilePath, const char* filePath)
+{
+    if (!flushFileToDisk(tempFilePath))
+    {
+        DeleteFileA(tempFilePath);
+        return false;
+    }
+
+    if (!MoveFileExA(tempFilePath, filePath, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+    {
+        DeleteFileA(tempFilePath);
+        return false;
+    }
+
+    return true;
+}
+
+// FNV-1a hash of the file's contents, 0 if it can't be read
+unsigned int getFileChecksum(const char* filePath)
+{
+    std::ifstream inFile(filePath, std::ios::binary);
+
+    if (!inFile.is_open())
+    {
+        return 0;
+    }
+
+    unsigned int hash = FNV_OFFSET_BASIS;
+    char buffer[4096];
+
+    while (inFile.read(buffer, sizeof(buffer)) || inFile.gcount() > 0)
+    {
+        for (std::streamsize i = 0; i < inFile.gcount(); i++)
+        {
+            hash = (hash ^ (unsigned char)buffer[i]) * FNV_PRIME;
+        }
+    }
+
+    return hash;
+}
+
 void strToLower(const char* inputStr, char* result)
 {
     if (inputStr == nullptr || result == nullptr)
@@ -346,6 +789,24 @@ char* getPlayerFilePath(const char* name)
     return filePath;
 }
 
+char* getPlayerJournalFilePath(const char* name)
+{
+    if (name == nullptr)
+    {
+        return nullptr;
+    }
+
+    char nameToLower[NAME_MAX_LENGTH];
+    strToLower(name, nameToLower);
+
+    const int foldersCount = 2;
+    const char playerDirPath[] = "../Players";
+    const char* folders[foldersCount] = { playerDirPath, nameToLower };
+    char* filePath = getFilePath(folders, foldersCount, "journal");
+
+    return filePath;
+}
+
 char* getPlayerNamesFilePath()
 {
     const char plNamesDirPath[] = "../Names";
@@ -371,1386 +832,5304 @@ bool readPlayerInfo(std::ifstream& inFile, Player& player)
     return true;
 }
 
-char** initMatrix(size_t rows, size_t cols)
+char* getPlayerStoreFilePath()
+{
+    const char playerStorePath[] = "../PlayerStore";
+    const int foldersCount = 1;
+    const char* folders[foldersCount] = { playerStorePath };
+    char* filePath = getFilePath(folders, foldersCount, "bin");
+
+    return filePath;
+}
+
+// The leaderboard index the player store replaced, read once to build the store
+char* getLegacyLeaderboardFilePath()
 {
-    char** matrix = new char* [rows];
+    const char leaderboardPath[] = "../Leaderboard";
+    const int foldersCount = 1;
+    const char* folders[foldersCount] = { leaderboardPath };
+    char* filePath = getFilePath(folders, foldersCount, "bin");
 
-    for (size_t i = 0; i < rows; i++)
-    {
-        matrix[i] = new char[cols];
-    }
+    return filePath;
+}
+
+void fillLeaderboardEntry(const Player& player, LeaderboardEntry& entry)
+{
+    entry = {};
+    strCopy(player.name, entry.name, 0);
+    entry.level = player.level;
+    entry.coins = player.coins;
+    entry.lives = player.lives;
+}
+
+bool isSameName(const char* firstName, const char* secondName)
+{
+    char firstToLower[NAME_MAX_LENGTH];
+    char secondToLower[NAME_MAX_LENGTH];
+    strToLower(firstName, firstToLower);
+    strToLower(secondName, secondToLower);
 
-    return matrix;
+    return strCompare(firstToLower, secondToLower) == 0;
 }
 
-void deleteMatrix(char**& matrix, size_t rows)
+unsigned int getNameHash(const char* name)
 {
-    if (matrix == nullptr)
+    unsigned int hash = FNV_OFFSET_BASIS;
+
+    for (int i = 0; name[i] != '\0'; i++)
     {
-        return;
+        hash = (hash ^ (unsigned char)toLower(name[i])) * FNV_PRIME;
     }
 
-    for (size_t i = 0; i < rows; i++)
+    return hash;
+}
+
+int getIndexSlotsCount(int recordsCount)
+{
+    int slotsCount = PLAYER_STORE_MIN_INDEX_SLOTS;
+
+    while (slotsCount < 4 * recordsCount)
     {
-        delete[] matrix[i];
+        slotsCount *= 2;
     }
 
-    delete[] matrix;
+    return slotsCount;
+}
 
-    matrix = nullptr;
+size_t getIndexSlotOffset(int indexSlot)
+{
+    return sizeof(PlayerStoreHeader) + indexSlot * sizeof(int);
 }
 
-void deleteMap(Map& map)
+size_t getRecordOffset(const PlayerStoreHeader& header, int slot)
 {
-    deleteMatrix(map.matrix, map.rowsCount);
-    delete[] map.portals;
+    return getIndexSlotOffset(header.indexSlotsCount) + slot * sizeof(LeaderboardEntry);
 }
 
-bool readMatrix(std::ifstream& inMap, Game& game)
+bool readPlayerStoreHeader(std::istream& file, PlayerStoreHeader& header)
 {
-    if (!inMap.is_open())
+    file.seekg(0);
+
+    if (!file.read((char*)&header, sizeof(PlayerStoreHeader)))
     {
         return false;
     }
 
-    Map& map = game.map;
-    int portalIdx = 0;
+    return memcmp(header.signature, PLAYER_STORE_SIGNATURE, sizeof(header.signature)) == 0
+        && header.version == PLAYER_STORE_VERSION
+        && header.recordsCount >= 0
+        && header.indexSlotsCount >= PLAYER_STORE_MIN_INDEX_SLOTS;
+}
 
-    for (size_t row = 0; row < map.rowsCount; row++)
+// Probes the index from the name's hash. Returns the player's record slot, or -1 with
+// indexSlot set to the empty index slot the name would be inserted at.
+// A record number past the records count was left by an interrupted insert and is skipped.
+int findPlayerRecord(std::istream& file, const PlayerStoreHeader& header, const char* name, int& indexSlot)
+{
+    int mask = header.indexSlotsCount - 1;
+    indexSlot = getNameHash(name) & mask;
+
+    for (int probesCount = 0; probesCount < header.indexSlotsCount; probesCount++)
     {
-        for (size_t col = 0; col < map.colsCount; col++)
-        {
-            char ch;
-            do
-            {
-                inMap.get(ch);
-            } while (ch == '\n');
+        int slot;
+        file.seekg(getIndexSlotOffset(indexSlot));
 
-            if (inMap.eof())
-            {
-                return false;
-            }
+        if (!file.read((char*)&slot, sizeof(int)))
+        {
+            return -1;
+        }
 
-            if (ch == PLAYER)
-            {
-                map.playerPosition = { row, col };
-                map.matrix[row][col] = SPACE;
-                continue;
-            }
-            if (ch == ENEMY)
-            {
-                map.enemyPosition = { row, col };
-                map.matrix[row][col] = SPACE;
-                continue;
-            }
+        if (slot == EMPTY_INDEX_SLOT)
+        {
+            return -1;
+        }
 
-            map.matrix[row][col] = ch;
+        if (slot < header.recordsCount)
+        {
+            LeaderboardEntry entry;
+            file.seekg(getRecordOffset(header, slot));
 
-            if (ch == COIN)
-            {
-                game.totalCoins++;
-            }
-            else if (ch == PORTAL)
+            if (file.read((char*)&entry, sizeof(LeaderboardEntry)) && isSameName(name, entry.name))
             {
-                map.portals[portalIdx] = { row, col };
-                portalIdx++;
+                return slot;
             }
         }
+
+        indexSlot = (indexSlot + 1) & mask;
     }
 
-    return true;
+    indexSlot = -1;
+    return -1;
 }
 
-bool readGame(Game& game, std::ifstream& inMap)
+// Rewrites the whole store with an index sized for the records, a name seen twice keeps its first record
+bool writePlayerStore(const std::vector<LeaderboardEntry>& records)
 {
-    if (!inMap.is_open())
+    std::vector<LeaderboardEntry> uniqueRecords;
+    std::vector<int> index(getIndexSlotsCount(records.size()), EMPTY_INDEX_SLOT);
+    int mask = index.size() - 1;
+
+    for (size_t i = 0; i < records.size(); i++)
     {
-        return false;
+        int indexSlot = getNameHash(records[i].name) & mask;
+
+        while (index[indexSlot] != EMPTY_INDEX_SLOT
+            && !isSameName(uniqueRecords[index[indexSlot]].name, records[i].name))
+        {
+            indexSlot = (indexSlot + 1) & mask;
+        }
+
+        if (index[indexSlot] == EMPTY_INDEX_SLOT)
+        {
+            index[indexSlot] = uniqueRecords.size();
+            uniqueRecords.push_back(records[i]);
+        }
     }
 
-    Map& map = game.map;
-    inMap >> map.rowsCount;
-    inMap >> map.colsCount;
-    inMap >> map.portalsCount;
-    inMap.ignore();
+    PlayerStoreHeader header = {};
+    memcpy(header.signature, PLAYER_STORE_SIGNATURE, sizeof(header.signature));
+    header.version = PLAYER_STORE_VERSION;
+    header.recordsCount = uniqueRecords.size();
+    header.indexSlotsCount = index.size();
 
-    map.matrix = initMatrix(map.rowsCount, map.colsCount);
-    map.portals = new MapCoordinate[map.portalsCount];
+    char* filePath = getPlayerStoreFilePath();
+    char* tempFilePath = getTempFilePath(filePath);
 
-    if (!readMatrix(inMap, game))
-    {
-        deleteMap(map);
-        return false;
-    }
+    std::ofstream outFile(tempFilePath, std::ios::binary);
+    outFile.write((const char*)&header, sizeof(PlayerStoreHeader));
+    outFile.write((const char*)index.data(), index.size() * sizeof(int));
+    outFile.write((const char*)uniqueRecords.data(), uniqueRecords.size() * sizeof(LeaderboardEntry));
+    outFile.close();
 
-    return true;
+    bool isCommitted = !outFile.fail() && commitTempFile(tempFilePath, filePath);
+
+    delete[] tempFilePath;
+    delete[] filePath;
+
+    return isCommitted;
 }
 
-bool readSavedGames(std::ifstream& inFile, Player& player)
+// Every player's record in slot order, read with one sequential read
+std::vector<LeaderboardEntry> readPlayerRecords()
 {
-    if (!inFile.is_open())
+    std::vector<LeaderboardEntry> records;
+    char* filePath = getPlayerStoreFilePath();
+
+    std::ifstream inFile(filePath, std::ios::binary);
+    delete[] filePath;
+
+    PlayerStoreHeader header;
+
+    if (!readPlayerStoreHeader(inFile, header))
     {
-        return false;
+        return records;
     }
 
-    while (inFile.peek() != EOF)
-    {
-        Game game = {};
-        inFile >> game.keyFound;
-        inFile >> game.coinsCollected;
-        inFile >> game.level;
-        game.totalCoins += game.coinsCollected;
+    records.resize(header.recordsCount);
 
-        readGame(game, inFile);
-        player.savedGamesPerLevel[game.level - 1] = game;
-        inFile.ignore();
-    }
+    inFile.seekg(getRecordOffset(header, 0));
+    inFile.read((char*)records.data(), records.size() * sizeof(LeaderboardEntry));
+    records.resize(inFile.gcount() / sizeof(LeaderboardEntry));
 
-    return true;
+    return records;
 }
 
-bool getPlayerByName(const char* name, Player& player)
+int findPlayerSlot(const char* name)
 {
-    if (name == nullptr)
+    char* filePath = getPlayerStoreFilePath();
+    std::ifstream inFile(filePath, std::ios::binary);
+    delete[] filePath;
+
+    PlayerStoreHeader header;
+
+    if (!readPlayerStoreHeader(inFile, header))
     {
-        return false;
+        return -1;
     }
 
-    char* filePath = getPlayerFilePath(name);
-    std::ifstream inFile(filePath);
+    int indexSlot;
+    return findPlayerRecord(inFile, header, name, indexSlot);
+}
+
+bool readPlayerRecord(int slot, LeaderboardEntry& entry)
+{
+    char* filePath = getPlayerStoreFilePath();
+    std::ifstream inFile(filePath, std::ios::binary);
     delete[] filePath;
 
-    if (!inFile.is_open())
+    PlayerStoreHeader header;
+
+    if (!readPlayerStoreHeader(inFile, header) || slot < 0 || slot >= header.recordsCount)
     {
         return false;
     }
 
-    readPlayerInfo(inFile, player);
-    inFile.ignore();
-    readSavedGames(inFile, player);
-
-    inFile.close();
-
-    return true;
+    inFile.seekg(getRecordOffset(header, slot));
+    return (bool)inFile.read((char*)&entry, sizeof(LeaderboardEntry));
 }
 
-int getDigitsCount(int num)
+// Appends the record and links it into the index, the records count is written last so an
+// interrupted insert leaves the store as it was. Returns the new slot, or -1 if the name is
+// taken or the store can't be written.
+int insertPlayerRecord(const LeaderboardEntry& entry)
 {
-    if (num == 0)
-    {
-        return 1;
-    }
+    char* filePath = getPlayerStoreFilePath();
+    std::fstream file(filePath, std::ios::in | std::ios::out | std::ios::binary);
 
-    int digitsCount = 0;
+    PlayerStoreHeader header;
 
-    while (num != 0)
+    if (!readPlayerStoreHeader(file, header))
     {
-        num /= 10;
-        digitsCount++;
+        delete[] filePath;
+        return -1;
     }
 
-    return digitsCount;
-}
+    int indexSlot;
+    if (findPlayerRecord(file, header, entry.name, indexSlot) != -1)
+    {
+        delete[] filePath;
+        return -1;
+    }
 
-char* intToString(size_t num)
-{
-    int digitsCount = getDigitsCount(num);
-    char* strNum = new char[digitsCount + 1];
-    strNum[digitsCount] = '\0';
-    int idx = digitsCount - 1;
+    file.clear();
+    int slot = header.recordsCount;
 
-    while (idx >= 0)
+    // The index is kept at most half full, a fuller one is rebuilt twice as large with the new record
+    if (indexSlot == -1 || 2 * (header.recordsCount + 1) > header.indexSlotsCount)
     {
-        strNum[idx] = (num % 10) + '0';
-        num /= 10;
-        idx--;
-    }
+        file.close();
+        delete[] filePath;
 
-    return strNum;
-}
+        std::vector<LeaderboardEntry> records = readPlayerRecords();
+        records.push_back(entry);
 
-void swap(int& first, int& second)
-{
-    int temp = first;
-    first = second;
-    second = temp;
-}
+        return writePlayerStore(records) ? slot : -1;
+    }
 
-void initRandom()
-{
-    srand(time(0));
-}
+    file.seekp(getRecordOffset(header, slot));
+    file.write((const char*)&entry, sizeof(LeaderboardEntry));
+    file.seekp(getIndexSlotOffset(indexSlot));
+    file.write((const char*)&slot, sizeof(int));
+    file.flush();
 
-int getRandomNumber(int min, int max)
-{
-    if (min > max)
+    bool isInserted = !file.fail() && flushFileToDisk(filePath);
+
+    if (isInserted)
     {
-        swap(min, max);
+        header.recordsCount++;
+        file.seekp(0);
+        file.write((const char*)&header, sizeof(PlayerStoreHeader));
+        file.close();
+
+        isInserted = !file.fail() && flushFileToDisk(filePath);
     }
 
-    int random = min + rand() % (max - min + 1);
-    return random;
+    delete[] filePath;
+
+    return isInserted ? slot : -1;
 }
 
-char* getMapFilePath(size_t level, size_t mapsCount)
+int findIndexedPlayer(const PlayerIndex& playerIndex, const char* name)
 {
-    if (level > MAX_LEVEL)
+    if (playerIndex.indexSlots.empty())
     {
-        return nullptr;
+        return -1;
     }
 
-    const char mapsDirPath[] = "../Maps";
-    char* strLevel = intToString(level);
+    char nameToLower[NAME_MAX_LENGTH];
+    strToLower(name, nameToLower);
 
-    int mapNumber = getRandomNumber(1, mapsCount);
-    char* strMapNumber = intToString(mapNumber);
+    int mask = playerIndex.indexSlots.size() - 1;
+    int indexSlot = getNameHash(nameToLower) & mask;
 
-    const int foldersCount = 3;
-    const char* mapsPathLevel[foldersCount] = { mapsDirPath, strLevel, strMapNumber };
-    char* filePath = getFilePath(mapsPathLevel, foldersCount);
+    while (playerIndex.indexSlots[indexSlot] != EMPTY_INDEX_SLOT)
+    {
+        int slot = playerIndex.indexSlots[indexSlot];
 
-    delete[] strLevel;
-    delete[] strMapNumber;
+        if (strCompare(nameToLower, playerIndex.foldedNames.data() + slot * NAME_MAX_LENGTH) == 0)
+        {
+            return slot;
+        }
 
-    return filePath;
-}
+        indexSlot = (indexSlot + 1) & mask;
+    }
 
-bool isSamePosition(const MapCoordinate& firstPosition, const MapCoordinate& secondPosition)
-{
-    return firstPosition.rowIdx == secondPosition.rowIdx
-        && firstPosition.colIdx == secondPosition.colIdx;
+    return -1;
 }
 
-void printPlayerInfo(const Player& player)
+void linkIndexedPlayer(PlayerIndex& playerIndex, int slot)
 {
-    std::cout << player.name << ": ";
+    const char* foldedName = playerIndex.foldedNames.data() + slot * NAME_MAX_LENGTH;
 
-    std::cout << player.level << " level; ";
-    std::cout << player.coins << " coins; ";
-    std::cout << player.lives << " lives";
-
-    std::cout << std::endl;
-}
+    int mask = playerIndex.indexSlots.size() - 1;
+    int indexSlot = getNameHash(foldedName) & mask;
 
-void swapPlayers(std::vector<Player>& players, size_t firstIdx, size_t secondIdx)
-{
-    if (firstIdx >= players.size() || secondIdx >= players.size())
+    while (playerIndex.indexSlots[indexSlot] != EMPTY_INDEX_SLOT)
     {
-        return;
+        indexSlot = (indexSlot + 1) & mask;
     }
 
-    Player temp = players[firstIdx];
-    players[firstIdx] = players[secondIdx];
-    players[secondIdx] = temp;
+    playerIndex.indexSlots[indexSlot] = slot;
 }
 
-int compareDesc(int first, int second)
+// Adds the player in the given store slot, the index is rebuilt twice as large once it is half full
+void addIndexedPlayer(PlayerIndex& playerIndex, const char* name, int slot)
 {
-    if (first > second)
+    if (slot < 0)
     {
-        return -1;
+        return;
     }
 
-    if (first < second)
+    if ((size_t)slot >= (size_t)playerIndex.playersCount)
     {
-        return 1;
+        playerIndex.playersCount = slot + 1;
+        playerIndex.foldedNames.resize(playerIndex.playersCount * NAME_MAX_LENGTH, '\0');
     }
 
-    return 0;
-}
+    strToLower(name, playerIndex.foldedNames.data() + slot * NAME_MAX_LENGTH);
 
-int comparePlayers(const Player& firstPlayer, const Player& secondPlayer)
-{
-    int result = compareDesc(firstPlayer.level, secondPlayer.level);
-    if (result != 0)
+    if (2 * playerIndex.playersCount <= (int)playerIndex.indexSlots.size())
     {
-        return result;
+        linkIndexedPlayer(playerIndex, slot);
+        return;
     }
 
-    result = compareDesc(firstPlayer.coins, secondPlayer.coins);
-    if (result != 0)
+    playerIndex.indexSlots.assign(getIndexSlotsCount(playerIndex.playersCount), EMPTY_INDEX_SLOT);
+
+    for (int i = 0; i < playerIndex.playersCount; i++)
     {
-        return result;
+        linkIndexedPlayer(playerIndex, i);
     }
-
-    result = compareDesc(firstPlayer.lives, secondPlayer.lives);
-    return result;
 }
 
-void sortPlayers(std::vector<Player>& players, int startIdx, int endIdx)
+// Reads the names from the store once at startup, later sign ups are added as they happen
+void loadPlayerIndex(PlayerIndex& playerIndex)
 {
-    size_t playersSize = players.size();
-    if ((!isValidIdx(startIdx, playersSize)) || (!isValidIdx(endIdx, playersSize)))
-    {
-        return;
-    }
+    std::vector<LeaderboardEntry> records = readPlayerRecords();
+
+    playerIndex = PlayerIndex();
+    playerIndex.indexSlots.assign(getIndexSlotsCount(records.size()), EMPTY_INDEX_SLOT);
 
-    if (startIdx >= endIdx)
+    for (size_t i = 0; i < records.size(); i++)
     {
-        return;
+        addIndexedPlayer(playerIndex, records[i].name, i);
     }
+}
 
-    int pivot = startIdx;
-    int left = pivot + 1;
-    int right = endIdx;
+// Updates the player's record in place, a player without one is inserted. Returns whether the record is on disk.
+bool updateLeaderboardEntry(Player& player)
+{
+    LeaderboardEntry entry;
+    fillLeaderboardEntry(player, entry);
 
-    while (left <= right)
+    if (player.leaderboardSlot == -1)
     {
-        if (comparePlayers(players[left], players[pivot]) > 0
-            && comparePlayers(players[right], players[pivot]) < 0)
-        {
-            swapPlayers(players, left, right);
-        }
-
-        if (comparePlayers(players[left], players[pivot]) <= 0)
-        {
-            left++;
-        }
-
-        if (comparePlayers(players[right], players[pivot]) >= 0)
-        {
-            right--;
-        }
+        player.leaderboardSlot = findPlayerSlot(player.name);
     }
 
-    swapPlayers(players, pivot, right);
-
-    int firstSubvectorStart = startIdx;
-    int firstSubvectorEnd = right - 1;
+    if (player.leaderboardSlot == -1)
+    {
+        player.leaderboardSlot = insertPlayerRecord(entry);
+        return player.leaderboardSlot != -1;
+    }
 
-    int secondSubvectorStart = right + 1;
-    int secondSubvectorEnd = endIdx;
+    char* filePath = getPlayerStoreFilePath();
+    std::fstream file(filePath, std::ios::in | std::ios::out | std::ios::binary);
 
-    int firstSubvectorSize = firstSubvectorEnd - firstSubvectorStart + 1;
-    int secondSubvectorSize = secondSubvectorEnd - secondSubvectorStart + 1;
+    PlayerStoreHeader header;
 
-    if (firstSubvectorSize <= secondSubvectorSize)
-    {
-        sortPlayers(players, firstSubvectorStart, firstSubvectorEnd);
-        sortPlayers(players, secondSubvectorStart, secondSubvectorEnd);
-    }
-    else
+    if (!readPlayerStoreHeader(file, header))
     {
-        sortPlayers(players, secondSubvectorStart, secondSubvectorEnd);
-        sortPlayers(players, firstSubvectorStart, firstSubvectorEnd);
+        delete[] filePath;
+        return false;
     }
+
+    file.seekp(getRecordOffset(header, player.leaderboardSlot));
+    file.write((const char*)&entry, sizeof(LeaderboardEntry));
+    file.close();
+
+    bool isUpdated = !file.fail() && flushFileToDisk(filePath);
+    delete[] filePath;
+
+    return isUpdated;
 }
 
-char** initDefaultMatrix(size_t rowCount, size_t colCount, char defaultSymbol)
+std::vector<LeaderboardEntry> readLegacyLeaderboard()
 {
-    char** matrix = new char* [rowCount];
+    std::vector<LeaderboardEntry> entries;
+    char* filePath = getLegacyLeaderboardFilePath();
 
-    for (size_t i = 0; i < rowCount; i++)
-    {
-        matrix[i] = new char[colCount];
+    std::ifstream inFile(filePath, std::ios::binary | std::ios::ate);
+    delete[] filePath;
 
-        for (size_t j = 0; j < colCount; j++)
-        {
-            matrix[i][j] = defaultSymbol;
-        }
+    if (!inFile.is_open())
+    {
+        return entries;
     }
 
-    return matrix;
+    size_t entriesCount = (size_t)inFile.tellg() / sizeof(LeaderboardEntry);
+    entries.resize(entriesCount);
+
+    inFile.seekg(0);
+    inFile.read((char*)entries.data(), entriesCount * sizeof(LeaderboardEntry));
+    inFile.close();
+
+    return entries;
 }
 
-void printMatrix(const Map& map, int playerColor, int enemyColor)
+// Builds the store once, for accounts created before it existed. The old leaderboard index has
+// the latest results, without it the names list and the player files are read.
+void initPlayerStore()
 {
-    if (map.matrix == nullptr)
+    char* storeFilePath = getPlayerStoreFilePath();
+    bool hasStore = fileExists(storeFilePath);
+    delete[] storeFilePath;
+
+    if (hasStore)
     {
         return;
     }
 
-    std::cout << std::endl;
+    std::vector<LeaderboardEntry> records = readLegacyLeaderboard();
 
-    for (size_t i = 0; i < map.rowsCount; i++)
+    if (records.empty())
     {
-        for (size_t j = 0; j < map.colsCount; j++)
+        char* namesFilePath = getPlayerNamesFilePath();
+        std::ifstream finPlayerNames(namesFilePath);
+        delete[] namesFilePath;
+
+        char name[NAME_MAX_LENGTH];
+
+        while (finPlayerNames.getline(name, NAME_MAX_LENGTH))
         {
-            MapCoordinate currPosition = { i, j };
+            char* playerFilePath = getPlayerFilePath(name);
+            std::ifstream finPlayer(playerFilePath);
+            delete[] playerFilePath;
 
-            if (isSamePosition(currPosition, map.playerPosition))
-            {
-                printCharWithColorAndReset(PLAYER, playerColor);
-            }
-            else if (isSamePosition(currPosition, map.enemyPosition))
-            {
-                printCharWithColorAndReset(ENEMY, enemyColor);
-            }
-            else
+            Player currPlayer = {};
+            if (!readPlayerInfo(finPlayer, currPlayer))
             {
-                std::cout << map.matrix[i][j];
+                continue;
             }
-            std::cout << "  ";
+
+            LeaderboardEntry entry;
+            fillLeaderboardEntry(currPlayer, entry);
+            records.push_back(entry);
         }
-        std::cout << std::endl;
     }
-    std::cout << std::endl;
+
+    writePlayerStore(records);
 }
 
-void printGameInfo(const Game& game, const Player& player)
+size_t getWordsCount(size_t bitsCount)
 {
-    std::cout << "Level: " << game.level << std::endl;
-    std::cout << "Lives: " << player.lives << std::endl;
-    std::cout << "Coins: " << game.coinsCollected << "/" << game.totalCoins << std::endl;
-    std::cout << "Key: ";
+    return (bitsCount + BITS_PER_WORD - 1) / BITS_PER_WORD;
+}
 
-    if (game.keyFound)
-    {
-        std::cout << "Found";
-    }
-    else
-    {
-        std::cout << "Not found";
-    }
+bool isBitSet(const std::vector<unsigned long long>& bits, int idx)
+{
+    return (bits[idx / BITS_PER_WORD] >> (idx % BITS_PER_WORD)) & 1;
+}
 
-    std::cout << std::endl;
+void setBit(std::vector<unsigned long long>& bits, int idx)
+{
+    bits[idx / BITS_PER_WORD] |= 1ULL << (idx % BITS_PER_WORD);
 }
 
-void printRulesToMove()
+int getCellsCount(const Map& map)
 {
-    std::cout << "Press one of the keys below:" << std::endl;
-    std::cout << "W - Up" << std::endl;
-    std::cout << "S - Down" << std::endl;
-    std::cout << "A - Left" << std::endl;
-    std::cout << "D - Right" << std::endl;
-    std::cout << "Q - Quit the level saving the progress" << std::endl;
+    return (map.rowsCount + 2) * map.stride;
 }
 
-int readNumber()
+int getCellIndex(const Map& map, const MapCoordinate& coordinate)
 {
-    int num;
-    std::cin >> num;
+    return (coordinate.rowIdx + 1) * map.stride + (coordinate.colIdx + 1);
+}
 
-    while (std::cin.fail())
+MapCoordinate getCellCoordinate(const Map& map, int cellIdx)
+{
+    size_t row = cellIdx / map.stride - 1;
+    size_t col = cellIdx % map.stride - 1;
+
+    return { row, col };
+}
+
+bool isCollectible(char ch)
+{
+    return ch == COIN || ch == KEY;
+}
+
+int findCollectibleNumber(const Map& map, int cellIdx)
+{
+    const int* collectiblesBegin = map.collectibleCells;
+    const int* collectiblesEnd = collectiblesBegin + map.collectiblesCount;
+    const int* found = std::lower_bound(collectiblesBegin, collectiblesEnd, cellIdx);
+
+    if (found == collectiblesEnd || *found != cellIdx)
     {
-        std::cout << "Invalid input! Please enter a number." << std::endl;
-        std::cin.clear();
-        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-        std::cin >> num;
+        return -1;
     }
 
-    return num;
+    return found - collectiblesBegin;
 }
 
-int getNumberInRange(int from, int to)
+bool isTileCleared(const Map& map, int cellIdx)
 {
-    int num = readNumber();
-
-    while (!isInRange(num, from, to))
+    if (map.clearedTiles.empty() || !isCollectible(map.matrix[cellIdx]))
     {
-        std::cout << "Invalid number! Please enter a number between " << from << " and " << to << std::endl;
-        num = readNumber();
+        return false;
     }
 
-    return num;
+    int collectibleNumber = findCollectibleNumber(map, cellIdx);
+    return collectibleNumber != -1 && isBitSet(map.clearedTiles, collectibleNumber);
 }
 
-int getInputOption()
+char getTile(const Map& map, const MapCoordinate& coordinate)
 {
-    std::cout << "Please choose one of the following options:" << std::endl;
-    std::cout << "1) Log in" << std::endl;
-    std::cout << "2) Sign up" << std::endl;
+    int cellIdx = getCellIndex(map, coordinate);
 
-    int inputOption = getNumberInRange(1, 2);
-    return inputOption;
+    if (isTileCleared(map, cellIdx))
+    {
+        return SPACE;
+    }
+
+    return map.matrix[cellIdx];
 }
 
-bool inputYesNo(const char* question)
+void setTile(Map& map, const MapCoordinate& coordinate, char ch)
 {
-    if (question == nullptr)
+    map.matrix[getCellIndex(map, coordinate)] = ch;
+}
+
+// Picked up coins and the key are recorded in the session's own bitset, the tiles may be shared
+void clearTile(Map& map, const MapCoordinate& coordinate)
+{
+    int collectibleNumber = findCollectibleNumber(map, getCellIndex(map, coordinate));
+    if (collectibleNumber == -1)
     {
-        return false;
+        return;
     }
 
-    std::cout << question;
-    std::cout << " Enter one of the numbers below:" << std::endl;
+    if (map.clearedTiles.empty())
+    {
+        map.clearedTiles.assign(getWordsCount(map.collectiblesCount), 0);
+    }
 
-    const int YES = 1;
-    const int NO = 2;
+    setBit(map.clearedTiles, collectibleNumber);
+}
 
-    std::cout << YES << ") Yes" << std::endl;
-    std::cout << NO << ") No" << std::endl;
+size_t getPortalsOffset(const Map& map)
+{
+    size_t cellsCount = getCellsCount(map);
+    return (cellsCount + alignof(MapCoordinate) - 1) / alignof(MapCoordinate) * alignof(MapCoordinate);
+}
 
-    int optionNumber = getNumberInRange(YES, NO);
-    return optionNumber == YES;
+// At most half of the slots are used, so probing stays short
+int getPortalSlotsCount(int portalsCount)
+{
+    int slotsCount = 1;
+
+    while (slotsCount < 2 * portalsCount)
+    {
+        slotsCount *= 2;
+    }
+
+    return slotsCount;
 }
 
-bool isValidCoordinate(const MapCoordinate& coordinate, int rows, int cols)
+size_t getPortalSlotsOffset(const Map& map)
 {
-    return coordinate.rowIdx < rows && coordinate.colIdx < cols;
+    return getPortalsOffset(map) + map.portalsCount * sizeof(MapCoordinate);
 }
 
-bool isValidEnemyMove(const MapCoordinate& newPosition, const Map& map)
+size_t getMapAllocationSize(const Map& map)
 {
-    return isValidCoordinate(newPosition, map.rowsCount, map.colsCount)
-        && (map.matrix[newPosition.rowIdx][newPosition.colIdx] != WALL)
-        && (map.matrix[newPosition.rowIdx][newPosition.colIdx] != VISITED);
+    return getPortalSlotsOffset(map) + map.portalSlotsCount * sizeof(PortalSlot);
 }
 
-bool changePosition(MapCoordinate& pCoordinate, char playerMove)
+char* allocateFromArena(MapArena& arena, size_t size)
 {
-    playerMove = toLower(playerMove);
+    size = (size + MAP_ARENA_ALIGNMENT - 1) / MAP_ARENA_ALIGNMENT * MAP_ARENA_ALIGNMENT;
 
-    switch (playerMove)
+    if (arena.blocks.empty() || arena.blockUsed + size > arena.blockSize)
     {
-    case UP:
-        pCoordinate.rowIdx--;
-        break;
+        arena.blockSize = std::max(size, MAP_ARENA_BLOCK_SIZE);
+        arena.blockUsed = 0;
+        arena.blocks.push_back(new char[arena.blockSize]);
+    }
 
-    case DOWN:
-        pCoordinate.rowIdx++;
-        break;
-
-    case LEFT:
-        pCoordinate.colIdx--;
-        break;
+    char* memory = arena.blocks.back() + arena.blockUsed;
+    arena.blockUsed += size;
 
-    case RIGHT:
-        pCoordinate.colIdx++;
-        break;
+    return memory;
+}
 
-    default:
-        return false;
+MapArena::~MapArena()
+{
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        delete[] blocks[i];
     }
-
-    return true;
 }
 
-MapCoordinate findNextPortal(const Map& map, const MapCoordinate& currPortal)
+// Tiles, portals and the portal table share one allocation. The tiles are surrounded by a wall border,
+// so neighbours of any inner cell can be read without bounds checks. Maps read into an arena don't own it.
+void initMatrix(Map& map, MapArena* arena = nullptr)
 {
-    MapCoordinate nextPortal = {};
+    map.stride = map.colsCount + 2;
+    map.portalSlotsCount = getPortalSlotsCount(map.portalsCount);
 
-    if (map.matrix == nullptr)
+    size_t cellsCount = getCellsCount(map);
+
+    if (arena != nullptr)
     {
-        return nextPortal;
+        map.matrix = allocateFromArena(*arena, getMapAllocationSize(map));
+        map.sharesTiles = true;
     }
-
-    for (size_t i = 0; i < map.portalsCount; i++)
+    else
     {
-        if (isSamePosition(currPortal, map.portals[i]))
-        {
-            if (i == map.portalsCount - 1)
-            {
-                nextPortal = map.portals[0];
-            }
-            else
-            {
-                nextPortal = map.portals[i + 1];
-            }
-
-            break;
-        }
+        map.matrix = new char[getMapAllocationSize(map)];
     }
 
-    return nextPortal;
-}
+    map.portals = (MapCoordinate*)(map.matrix + getPortalsOffset(map));
+    map.portalSlots = (PortalSlot*)(map.matrix + getPortalSlotsOffset(map));
 
-void restoreMatrix(Map& map, const std::vector<VisitedCell>& visitedCells)
-{
-    for (size_t i = 0; i < visitedCells.size(); i++)
+    for (size_t i = 0; i < cellsCount; i++)
     {
-        char originalContent = visitedCells[i].originalContent;
-        size_t row = visitedCells[i].coordinate.rowIdx;
-        size_t col = visitedCells[i].coordinate.colIdx;
+        map.matrix[i] = WALL;
+    }
 
-        map.matrix[row][col] = originalContent;
+    for (int i = 0; i < map.portalsCount; i++)
+    {
+        map.portals[i] = {};
     }
 }
 
-void markVisited(Map& map, const MapCoordinate& position, int parentIndex, int steps, std::vector<VisitedCell>& visitedCells)
+// Done once when a map is read. Games started from it share the numbers, so the bitset of what a
+// game picked up takes a bit per coin instead of a bit per cell of the map.
+void numberCollectibles(Map& map, MapArena* arena)
 {
-    size_t row = position.rowIdx;
-    size_t col = position.colIdx;
-
-    char originalSymbol = map.matrix[row][col];
-    map.matrix[row][col] = VISITED;
-    visitedCells.push_back({ originalSymbol, steps, parentIndex, position });
-}
+    size_t cellsCount = getCellsCount(map);
+    map.collectiblesCount = 0;
 
-MapCoordinate restorePath(const std::vector<VisitedCell>& visitedCells, const Map& map, size_t enemyStepsPerMove)
-{
-    VisitedCell currCell = visitedCells[visitedCells.size() - 1];
-    int totalSteps = currCell.steps;
-    int stepsBack = totalSteps - enemyStepsPerMove;
-    if (stepsBack <= 0)
+    for (size_t i = 0; i < cellsCount; i++)
     {
-        return map.playerPosition;
+        map.collectiblesCount += isCollectible(map.matrix[i]);
     }
 
-    for (size_t i = 0; i < stepsBack; i++)
+    if (arena != nullptr)
+    {
+        map.collectibleCells = (int*)allocateFromArena(*arena, map.collectiblesCount * sizeof(int));
+    }
+    else
     {
-        VisitedCell parent = visitedCells[currCell.parentIndex];
-        currCell = parent;
+        map.collectibleCells = new int[map.collectiblesCount];
     }
 
-    return currCell.coordinate;
+    int collectibleNumber = 0;
+
+    for (size_t i = 0; i < cellsCount; i++)
+    {
+        if (isCollectible(map.matrix[i]))
+        {
+            map.collectibleCells[collectibleNumber] = i;
+            collectibleNumber++;
+        }
+    }
 }
 
-MapCoordinate findShortestPath(Map& map, std::vector<VisitedCell>& visitedCells, size_t enemyStepsPerMove)
+int getPortalSlotIdx(const Map& map, int cellIdx)
 {
-    MapCoordinate enemyNewPosition = {};
+    unsigned int hash = (unsigned int)cellIdx * 2654435761u;
+    return hash & (map.portalSlotsCount - 1);
+}
 
-    if (map.matrix == nullptr)
+// Built once when a map is read, so teleporting doesn't scan the portals
+void indexPortals(Map& map)
+{
+    for (int i = 0; i < map.portalSlotsCount; i++)
     {
-        return enemyNewPosition;
+        map.portalSlots[i] = { -1, -1 };
     }
 
-    std::vector<MapCoordinate> queue;
-    queue.push_back(map.enemyPosition);
-
-    int parentIndex = -1;
-    const int initialSteps = 0;
-    markVisited(map, map.enemyPosition, parentIndex, initialSteps, visitedCells);
-
-    bool pathFound = false;
-
-    while (queue.size() > 0)
+    for (int i = 0; i < map.portalsCount; i++)
     {
-        parentIndex++;
-
-        MapCoordinate currPosition = queue[0];
-        queue.erase(queue.begin());
+        int cellIdx = getCellIndex(map, map.portals[i]);
+        int slotIdx = getPortalSlotIdx(map, cellIdx);
 
-        const int directionsRows = 4;
-        const int directionsCols = 2;
-        int directions[directionsRows][directionsCols] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
-        for (size_t i = 0; i < directionsRows; i++)
+        while (map.portalSlots[slotIdx].cellIdx != -1 && map.portalSlots[slotIdx].cellIdx != cellIdx)
         {
-            size_t newRow = currPosition.rowIdx + directions[i][0];
-            size_t newCol = currPosition.colIdx + directions[i][1];
-            MapCoordinate newPosition = { newRow, newCol };
-
-            if (!isValidEnemyMove(newPosition, map))
-            {
-                continue;
-            }
-
-            int steps = visitedCells[parentIndex].steps + 1;
-            markVisited(map, newPosition, parentIndex, steps, visitedCells);
-
-            if (newRow == map.playerPosition.rowIdx
-                && newCol == map.playerPosition.colIdx)
-            {
-                pathFound = true;
-                break;
-            }
-
-            queue.push_back(newPosition);
+            slotIdx = (slotIdx + 1) & (map.portalSlotsCount - 1);
         }
 
-        if (pathFound)
+        // A portal listed twice keeps its first position
+        if (map.portalSlots[slotIdx].cellIdx == -1)
         {
-            break;
+            map.portalSlots[slotIdx] = { cellIdx, i };
         }
     }
-
-    restoreMatrix(map, visitedCells);
-    enemyNewPosition = restorePath(visitedCells, map, enemyStepsPerMove);
-    visitedCells.clear();
-    
-    return enemyNewPosition;
 }
 
-MoveResult move(Player& player, Game& game, char playerMove)
+// Returns the position of the portal on the cell in map.portals or -1 if there is no portal
+int findPortalIdx(const Map& map, int cellIdx)
 {
-    char** matrix = game.map.matrix;
-    MapCoordinate& plCoordinate = game.map.playerPosition;
-    MapCoordinate newPosition = plCoordinate;
-
-    if (matrix == nullptr)
-    {
-        return INVALID_MOVE;
-    }
-
-    if (!changePosition(newPosition, playerMove))
+    if (map.portalSlots == nullptr)
     {
-        return INVALID_MOVE;
+        return -1;
     }
 
-    if (!isValidCoordinate(newPosition, game.map.rowsCount, game.map.colsCount))
-    {
-        return INVALID_MOVE;
-    }
-    if (isSamePosition(newPosition, game.map.enemyPosition))
-    {
-        player.lives = 0;
-        return ENEMY_ENCOUNTER;
-    }
+    int slotIdx = getPortalSlotIdx(map, cellIdx);
 
-    switch (matrix[newPosition.rowIdx][newPosition.colIdx])
+    while (map.portalSlots[slotIdx].cellIdx != -1)
     {
-    case WALL:
-        player.lives--;
-        return WALL_HIT;
-
-    case SPACE:
-        plCoordinate = newPosition;
-        return NONE;
-
-    case COIN:
-        game.coinsCollected++;
-        plCoordinate = newPosition;
-        matrix[newPosition.rowIdx][newPosition.colIdx] = SPACE;
-        return COIN_COLLECTED;
-
-    case KEY:
-        game.keyFound = true;
-        plCoordinate = newPosition;
-        matrix[newPosition.rowIdx][newPosition.colIdx] = SPACE;
-        return KEY_FOUND;
-
-    case PORTAL:
-        plCoordinate = findNextPortal(game.map, newPosition);
-        return TELEPORTATION;
-
-    case TREASURE:
-        plCoordinate = newPosition;
-
-        if (game.keyFound)
+        if (map.portalSlots[slotIdx].cellIdx == cellIdx)
         {
-            return TREASURE_WITH_KEY;
+            return map.portalSlots[slotIdx].portalIdx;
         }
 
-        return TREASURE_WITHOUT_KEY;
-
-    default:
-        return INVALID_MOVE;
+        slotIdx = (slotIdx + 1) & (map.portalSlotsCount - 1);
     }
-}
 
-bool winCondition(MoveResult moveRes)
-{
-    return moveRes == TREASURE_WITH_KEY;
+    return -1;
 }
 
-bool lossCondition(const Player& player)
+// Returns the cell index the portal on the cell leads to or -1 if there is no portal
+int getPortalExitIdx(const Map& map, int cellIdx)
 {
-    return player.lives == 0;
-}
+    int portalIdx = findPortalIdx(map, cellIdx);
 
-void winUpdate(const Game& game, Player& player)
-{
-    if (game.map.matrix == nullptr)
+    if (portalIdx == -1)
     {
-        return;
+        return -1;
     }
 
-    player.coins += game.coinsCollected;
+    return getCellIndex(map, map.portals[(portalIdx + 1) % map.portalsCount]);
+}
 
-    if ((game.level != MAX_LEVEL)
-        && player.level == game.level)
+void deleteMap(Map& map)
+{
+    if (!map.sharesTiles)
     {
-        player.level++;
+        delete[] map.matrix;
+        delete[] map.collectibleCells;
     }
+
+    map.matrix = nullptr;
+    map.portals = nullptr;
+    map.portalSlots = nullptr;
+    map.collectibleCells = nullptr;
+    map.paths = nullptr;
+    map.sharesTiles = false;
+    map.clearedTiles.clear();
 }
 
-void lossUpdate(Player& player)
+// Copies the size, positions and tile pointers, not the ownership or the cleared tiles
+void copyMapLayout(Map& map, const Map& source)
 {
-    player.lives = 1;
+    map.rowsCount = source.rowsCount;
+    map.colsCount = source.colsCount;
+    map.stride = source.stride;
+    map.portalsCount = source.portalsCount;
+    map.matrix = source.matrix;
+    map.playerPosition = source.playerPosition;
+    map.enemyPosition = source.enemyPosition;
+    map.portals = source.portals;
+    map.portalSlots = source.portalSlots;
+    map.portalSlotsCount = source.portalSlotsCount;
+    map.collectibleCells = source.collectibleCells;
+    map.collectiblesCount = source.collectiblesCount;
+    map.paths = source.paths;
 }
 
-bool savePlayerInfo(std::ofstream& outFile, const Player& player)
+Map::Map(Map&& other) noexcept
 {
-    if (!outFile.is_open())
+    *this = std::move(other);
+}
+
+Map& Map::operator=(Map&& other) noexcept
+{
+    if (this == &other)
     {
-        return false;
+        return *this;
     }
 
-    outFile << player.name << std::endl;
-    outFile << player.level << std::endl;
-    outFile << player.lives << std::endl;
-    outFile << player.coins << std::endl;
+    deleteMap(*this);
+    copyMapLayout(*this, other);
+    sharesTiles = other.sharesTiles;
+    clearedTiles = std::move(other.clearedTiles);
 
-    return true;
+    other.matrix = nullptr;
+    other.portals = nullptr;
+    other.portalSlots = nullptr;
+    other.collectibleCells = nullptr;
+    other.paths = nullptr;
+    other.sharesTiles = false;
+    other.clearedTiles.clear();
+
+    return *this;
 }
 
-bool appendMapInfo(std::ofstream& outFile, const Map& map)
+Map::~Map()
 {
-    if (!outFile.is_open())
+    deleteMap(*this);
+}
+
+bool readMatrix(std::ifstream& inMap, Game& game)
+{
+    if (!inMap.is_open())
     {
         return false;
     }
 
-    outFile << map.rowsCount << std::endl;
-    outFile << map.colsCount << std::endl;
-    outFile << map.portalsCount << std::endl;
+    Map& map = game.map;
+    int portalIdx = 0;
 
-    for (size_t i = 0; i < map.rowsCount; i++)
+    for (size_t row = 0; row < map.rowsCount; row++)
     {
-        for (size_t j = 0; j < map.colsCount; j++)
+        for (size_t col = 0; col < map.colsCount; col++)
         {
-            MapCoordinate currPosition = { i, j };
+            char ch;
+            do
+            {
+                inMap.get(ch);
+            } while (ch == '\n');
 
-            if (isSamePosition(currPosition, map.playerPosition))
+            if (inMap.eof())
             {
-                outFile << PLAYER;
+                return false;
             }
-            else if (isSamePosition(currPosition, map.enemyPosition))
+
+            if (ch == PLAYER)
             {
-                outFile << ENEMY;
+                map.playerPosition = { row, col };
+                setTile(map, map.playerPosition, SPACE);
+                continue;
             }
-            else
+            if (ch == ENEMY)
+            {
+                map.enemyPosition = { row, col };
+                setTile(map, map.enemyPosition, SPACE);
+                continue;
+            }
+
+            setTile(map, { row, col }, ch);
+
+            if (ch == COIN)
+            {
+                game.totalCoins++;
+            }
+            else if (ch == PORTAL)
             {
-                outFile << map.matrix[i][j];
+                if (portalIdx >= map.portalsCount)
+                {
+                    return false;
+                }
+
+                map.portals[portalIdx] = { row, col };
+                portalIdx++;
             }
         }
-        outFile << std::endl;
     }
 
+    indexPortals(map);
+
     return true;
 }
 
-bool appendGameInfo(std::ofstream& outFile, const Game& game)
+bool readGame(Game& game, std::ifstream& inMap, MapArena* arena = nullptr)
 {
-    if (game.map.matrix == nullptr)
+    if (!inMap.is_open())
     {
         return false;
     }
 
-    if (!outFile.is_open())
+    Map& map = game.map;
+    inMap >> map.rowsCount;
+    inMap >> map.colsCount;
+    inMap >> map.portalsCount;
+    inMap.ignore();
+
+    if (!inMap || map.rowsCount <= 0 || map.colsCount <= 0 || map.portalsCount < 0)
     {
+        map.matrix = nullptr;
         return false;
     }
 
-    outFile << game.keyFound << std::endl;
-    outFile << game.coinsCollected << std::endl;
-    outFile << game.level << std::endl;
+    initMatrix(map, arena);
 
-    appendMapInfo(outFile, game.map);
+    if (!readMatrix(inMap, game))
+    {
+        deleteMap(map);
+        return false;
+    }
+
+    numberCollectibles(map, arena);
 
     return true;
 }
 
-bool appendPlayerNameToFile(const char* name)
+bool isInnerPosition(const Map& map, int row, int col)
 {
-    if (name == nullptr)
+    return isInRange(row, 0, map.rowsCount - 1) && isInRange(col, 0, map.colsCount - 1);
+}
+
+// The player and the enemy are stored as spaces, so these are the only tiles a binary map may hold
+bool isStoredTile(char ch)
+{
+    return ch == SPACE
+        || ch == WALL
+        || ch == COIN
+        || ch == PORTAL
+        || ch == KEY
+        || ch == TREASURE;
+}
+
+// Fills the game from a binary map held in memory, checking every offset against the data size
+bool parseBinaryMap(Game& game, const char* data, size_t dataSize, MapArena* arena)
+{
+    if (dataSize < sizeof(MapFileHeader))
     {
         return false;
     }
 
-    char nameToLower[NAME_MAX_LENGTH];
-    strToLower(name, nameToLower);
-    char* plFilePath = getPlayerFilePath(nameToLower);
+    const MapFileHeader* header = (const MapFileHeader*)data;
 
-    if (fileExists(plFilePath))
+    if (memcmp(header->signature, MAP_FILE_SIGNATURE, sizeof(header->signature)) != 0
+        || header->version != MAP_FILE_VERSION
+        || header->rowsCount <= 0 || header->colsCount <= 0
+        || header->portalsCount < 0 || header->coinsCount < 0)
     {
-        delete[] plFilePath;
         return false;
     }
 
-    delete[] plFilePath;
+    size_t portalsSize = (size_t)header->portalsCount * 2 * sizeof(int);
+    size_t tilesSize = (size_t)header->rowsCount * header->colsCount;
 
-    char* filePath = getPlayerNamesFilePath();
+    if (dataSize != sizeof(MapFileHeader) + portalsSize + tilesSize)
+    {
+        return false;
+    }
 
-    std::ofstream outFile(filePath, std::ios::app);
-    delete[] filePath;
+    Map& map = game.map;
+    map.rowsCount = header->rowsCount;
+    map.colsCount = header->colsCount;
+    map.portalsCount = header->portalsCount;
 
-    if (!outFile.is_open())
+    if (!isInnerPosition(map, header->playerRow, header->playerCol)
+        || !isInnerPosition(map, header->enemyRow, header->enemyCol))
     {
         return false;
     }
 
-    outFile << nameToLower << std::endl;
-    outFile.close();
+    map.playerPosition = { (size_t)header->playerRow, (size_t)header->playerCol };
+    map.enemyPosition = { (size_t)header->enemyRow, (size_t)header->enemyCol };
 
-    return true;
-}
+    initMatrix(map, arena);
 
-void enterUsername(Player& player)
-{
-    std::cout << "Please enter username:" << std::endl;
-    std::cin.getline(player.name, NAME_MAX_LENGTH);
+    const int* portalCells = (const int*)(data + sizeof(MapFileHeader));
 
-    while (getStrLen(player.name) < NAME_MIN_LENGTH)
+    for (int i = 0; i < map.portalsCount; i++)
     {
-        std::cout << "Your name must have at least " << NAME_MIN_LENGTH << " symbols. Please, try again!" << std::endl;
-        std::cin.getline(player.name, NAME_MAX_LENGTH);
+        int row = portalCells[2 * i];
+        int col = portalCells[2 * i + 1];
+
+        if (!isInnerPosition(map, row, col))
+        {
+            deleteMap(map);
+            return false;
+        }
+
+        map.portals[i] = { (size_t)row, (size_t)col };
     }
-}
 
-bool savePlayerGames(std::ofstream& outFile, const Player& player)
-{
-    if (!outFile.is_open())
+    // Tile rows are copied whole, the wall border set up by initMatrix stays untouched. The copied
+    // tiles are checked against the header, the file may have been edited or damaged.
+    const char* tiles = data + sizeof(MapFileHeader) + portalsSize;
+    int coinsCount = 0;
+    int portalTilesCount = 0;
+
+    for (size_t row = 0; row < (size_t)map.rowsCount; row++)
     {
-        return false;
-    }
+        char* rowTiles = map.matrix + getCellIndex(map, { row, 0 });
+        memcpy(rowTiles, tiles + row * map.colsCount, map.colsCount);
 
-    for (size_t i = 0; i < player.level; i++)
-    {
-        const Game& savedGame = player.savedGamesPerLevel[i];
+        for (int col = 0; col < map.colsCount; col++)
+        {
+            if (!isStoredTile(rowTiles[col]))
+            {
+                deleteMap(map);
+                return false;
+            }
 
-        if (savedGame.map.matrix == nullptr)
+            coinsCount += rowTiles[col] == COIN;
+            portalTilesCount += rowTiles[col] == PORTAL;
+        }
+    }
+
+    for (int i = 0; i < map.portalsCount; i++)
+    {
+        if (map.matrix[getCellIndex(map, map.portals[i])] != PORTAL)
         {
-            continue;
+            deleteMap(map);
+            return false;
         }
+    }
 
-        appendGameInfo(outFile, savedGame);
+    if (coinsCount != header->coinsCount || portalTilesCount != map.portalsCount)
+    {
+        deleteMap(map);
+        return false;
     }
 
+    indexPortals(map);
+    numberCollectibles(map, arena);
+
+    game.totalCoins += coinsCount;
+
     return true;
 }
 
-bool savePlayerProgress(const Player& player)
+// Maps the file into memory and reads the map straight from the view, without stream parsing
+bool readBinaryMap(Game& game, const char* filePath, MapArena* arena = nullptr)
 {
-    if (player.name == nullptr)
+    HANDLE file = CreateFileA(filePath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
     {
         return false;
     }
 
-    char* filePath = getPlayerFilePath(player.name);
-    std::ofstream outFile(filePath);
-    delete[] filePath;
+    LARGE_INTEGER fileSize;
+    HANDLE mapping = nullptr;
+    const char* view = nullptr;
 
-    if (!outFile.is_open())
+    if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
     {
-        return false;
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
     }
 
-    savePlayerInfo(outFile, player);
-    savePlayerGames(outFile, player);
+    if (mapping != nullptr)
+    {
+        view = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    }
 
-    outFile.close();
+    bool isRead = view != nullptr && parseBinaryMap(game, view, (size_t)fileSize.QuadPart, arena);
 
-    return true;
+    if (view != nullptr)
+    {
+        UnmapViewOfFile(view);
+    }
+
+    if (mapping != nullptr)
+    {
+        CloseHandle(mapping);
+    }
+
+    CloseHandle(file);
+
+    return isRead;
 }
 
-int getGameLevel(const Player& player)
+bool writeBinaryMap(const Game& game, const char* filePath)
 {
-    int maxLevel = player.level;
+    const Map& map = game.map;
 
-    if (maxLevel == MIN_LEVEL)
+    if (map.matrix == nullptr)
     {
-        return maxLevel;
+        return false;
     }
 
-    std::cout << "Please enter the level you want to play. It must be between " << MIN_LEVEL << " and " << maxLevel << std::endl;
-    return getNumberInRange(MIN_LEVEL, maxLevel);
-}
+    MapFileHeader header = {};
+    memcpy(header.signature, MAP_FILE_SIGNATURE, sizeof(header.signature));
+    header.version = MAP_FILE_VERSION;
+    header.rowsCount = map.rowsCount;
+    header.colsCount = map.colsCount;
+    header.portalsCount = map.portalsCount;
+    header.coinsCount = game.totalCoins;
+    header.playerRow = map.playerPosition.rowIdx;
+    header.playerCol = map.playerPosition.colIdx;
+    header.enemyRow = map.enemyPosition.rowIdx;
+    header.enemyCol = map.enemyPosition.colIdx;
 
-std::vector<Player> getAllPlayers(const Player& player)
-{
-    std::vector<Player> allPlayers;
-    char* namesFilePath = getPlayerNamesFilePath();
+    std::ofstream outFile(filePath, std::ios::binary);
 
-    std::ifstream finPlayerNames(namesFilePath);
-    delete[] namesFilePath;
+    if (!outFile.is_open())
+    {
+        return false;
+    }
 
-    if (!finPlayerNames.is_open())
+    outFile.write((const char*)&header, sizeof(MapFileHeader));
+
+    for (int i = 0; i < map.portalsCount; i++)
     {
-        return allPlayers;
+        int portalCell[2] = { (int)map.portals[i].rowIdx, (int)map.portals[i].colIdx };
+        outFile.write((const char*)portalCell, sizeof(portalCell));
     }
 
-    char playerNameToLower[NAME_MAX_LENGTH];
-    strToLower(player.name, playerNameToLower);
-    char name[NAME_MAX_LENGTH];
+    for (size_t row = 0; row < (size_t)map.rowsCount; row++)
+    {
+        outFile.write(map.matrix + getCellIndex(map, { row, 0 }), map.colsCount);
+    }
 
-    while (finPlayerNames.getline(name, NAME_MAX_LENGTH))
+    outFile.close();
+
+    return !outFile.fail();
+}
+
+bool readSavedGames(std::ifstream& inFile, Player& player)
+{
+    if (!inFile.is_open())
     {
-        if (strCompare(playerNameToLower, name) == 0)
-        {
-            allPlayers.push_back(player);
-            continue;
-        }
+        return false;
+    }
 
-        char* playerFilePath = getPlayerFilePath(name);
-        std::ifstream finPlayer(playerFilePath);
-        delete[] playerFilePath;
+    while (inFile.peek() != EOF)
+    {
+        Game game = {};
+        inFile >> game.keyFound;
+        inFile >> game.coinsCollected;
+        inFile >> game.level;
+        game.totalCoins += game.coinsCollected;
 
-        Player currPlayer = {};
-        if (!readPlayerInfo(finPlayer, currPlayer))
+        if (!isInRange(game.level, MIN_LEVEL, MAX_LEVEL) || !readGame(game, inFile))
         {
-            finPlayerNames.close();
-            return allPlayers;
+            return false;
         }
 
-        finPlayer.close();
-        allPlayers.push_back(currPlayer);
+        player.savedGamesPerLevel[game.level - 1] = std::move(game);
+        inFile.ignore();
     }
 
-    finPlayerNames.close();
-    return allPlayers;
+    return true;
 }
 
-int enemyMovesPerPlayerMove(const Game& game)
+int getDigitsCount(int num)
 {
-    if (game.level == MAX_LEVEL)
+    if (num == 0)
     {
-        return 2;
+        return 1;
     }
 
-    return 1;
+    int digitsCount = 0;
+
+    while (num != 0)
+    {
+        num /= 10;
+        digitsCount++;
+    }
+
+    return digitsCount;
 }
 
-Game setUpGame(Player& player)
+char* intToString(size_t num)
 {
-    int level = getGameLevel(player);
-    Game& savedGame = player.savedGamesPerLevel[level - 1];
+    int digitsCount = getDigitsCount(num);
+    char* strNum = new char[digitsCount + 1];
+    strNum[digitsCount] = '\0';
+    int idx = digitsCount - 1;
 
-    if (savedGame.map.matrix != nullptr)
+    while (idx >= 0)
     {
-        bool continuePrevGame = inputYesNo("Would you like to continue from where you left off?");
-
-        if (continuePrevGame)
-        {
-            return savedGame;
-        }
-
-        deleteMap(savedGame.map);
+        strNum[idx] = (num % 10) + '0';
+        num /= 10;
+        idx--;
     }
 
-    Game game = {};
-    game.level = level;
+    return strNum;
+}
 
-    const int MAPS_COUNT = 2;
+void swap(int& first, int& second)
+{
+    int temp = first;
+    first = second;
+    second = temp;
+}
 
-    char* filePath = getMapFilePath(game.level, MAPS_COUNT);
-    std::ifstream mapFile(filePath);
-    delete[] filePath;
+void initRandom()
+{
+    srand(time(0));
+}
 
-    if (!mapFile.is_open())
+int getRandomNumber(int min, int max)
+{
+    if (min > max)
     {
-        return game;
+        swap(min, max);
     }
 
-    readGame(game, mapFile);
-    mapFile.close();
-    return game;
+    int random = min + rand() % (max - min + 1);
+    return random;
 }
 
-void printMoveResult(MoveResult moveRes)
+bool hasExtension(const char* fileName, const char* extension)
 {
-    switch (moveRes)
-    {
-    case ENEMY_ENCOUNTER:
-        std::cout << "You were captured by enemy!" << std::endl;
-        break;
-
-    case WALL_HIT:
-        std::cout << "Ouch! You hit a wall!" << std::endl;
-        break;
+    const char* extensionStart = strrchr(fileName, '.');
 
-    case COIN_COLLECTED:
-        std::cout << "You collected a coin!" << std::endl;
-        break;
+    return extensionStart != nullptr && strCompare(extensionStart + 1, extension) == 0;
+}
 
-    case KEY_FOUND:
-        std::cout << "You found the key! Now find the treasure!" << std::endl;
-        break;
+// FNV-1a hash of the map's size, tiles and starting positions, so a journal can't replay moves on an edited map
+unsigned int getMapId(const Map& map)
+{
+    unsigned int hash = FNV_OFFSET_BASIS;
+    int values[] = { map.rowsCount, map.colsCount,
+        getCellIndex(map, map.playerPosition), getCellIndex(map, map.enemyPosition) };
 
-    case TELEPORTATION:
-        std::cout << "Whoosh! You teleported successfully!" << std::endl;
-        break;
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+    {
+        hash = (hash ^ values[i]) * FNV_PRIME;
+    }
 
-    case TREASURE_WITHOUT_KEY:
-        std::cout << "You need a key to open the treasure!" << std::endl;
-        break;
+    size_t cellsCount = getCellsCount(map);
 
-    case TREASURE_WITH_KEY:
-        std::cout << "Congratulations! You win!" << std::endl;
-        break;
+    for (size_t i = 0; i < cellsCount; i++)
+    {
+        hash = (hash ^ (unsigned char)map.matrix[i]) * FNV_PRIME;
     }
+
+    // 0 is left for games without a catalog map
+    return hash == 0 ? 1 : hash;
 }
 
-void lossUpdateAndPrint(Player& player, MoveResult moveRes)
+const Game* findMapTemplate(const MapCatalog& catalog, int level, unsigned int mapId)
 {
-    lossUpdate(player);
-    printMoveResult(moveRes);
-    std::cout << "You lose! Better luck next game!" << std::endl;
+    const std::vector<Game>& levelMaps = catalog.levelMaps[level - 1];
+
+    for (size_t i = 0; i < levelMaps.size(); i++)
+    {
+        if (levelMaps[i].mapId == mapId)
+        {
+            return &levelMaps[i];
+        }
+    }
+
+    return nullptr;
 }
 
-void playGame(Game& game, Player& player)
+// A text map that has a binary copy is skipped, so every map is loaded once
+bool hasConvertedCopy(const char* filePath)
 {
-    if (game.map.matrix == nullptr)
+    if (!hasExtension(filePath, "txt") || getStrLen(filePath) >= MAX_PATH)
     {
-        return;
+        return false;
     }
 
-    clearConsole();
-    char playerMove;
-    MoveResult moveRes = NONE;
+    char binFilePath[MAX_PATH];
+    strCopy(filePath, binFilePath, 0);
+    strCopy("bin", binFilePath, strrchr(binFilePath, '.') - binFilePath + 1);
+
+    return fileExists(binFilePath);
+}
+
+void loadLevelMaps(int level, std::vector<Game>& levelMaps, MapArena& arena)
+{
+    const char mapsDirPath[] = "../Maps";
+    const char allFiles[] = "*";
+    char* strLevel = intToString(level);
 
-    int capacity = (game.map.rowsCount * game.map.colsCount) / 2;
-    std::vector<VisitedCell> visitedCells;
-    visitedCells.reserve(capacity);
+    const int foldersCount = 3;
+    const char* pattern[foldersCount] = { mapsDirPath, strLevel, allFiles };
+    char* patternPath = getFilePath(pattern, foldersCount, "");
 
-    int enemyMoves = enemyMovesPerPlayerMove(game);
+    WIN32_FIND_DATAA fileData;
+    HANDLE findHandle = FindFirstFileA(patternPath, &fileData);
+    delete[] patternPath;
 
-    while (true)
+    if (findHandle == INVALID_HANDLE_VALUE)
     {
-        printGameInfo(game, player);
-        printMatrix(game.map, GREEN_COLOR, RED_COLOR);
-        printMoveResult(moveRes);
-        printRulesToMove();
+        delete[] strLevel;
+        return;
+    }
 
-        std::cin >> playerMove;
-        clearConsole();
+    do
+    {
+        const char* mapPath[foldersCount] = { mapsDirPath, strLevel, fileData.cFileName };
+        char* filePath = getFilePath(mapPath, foldersCount, "");
 
-        if (toLower(playerMove) == QUIT)
+        if (hasConvertedCopy(filePath))
         {
-            player.savedGamesPerLevel[game.level - 1] = game;
-            return;
+            delete[] filePath;
+            continue;
         }
 
-        moveRes = move(player, game, playerMove);
-        if (winCondition(moveRes))
-        {
-            winUpdate(game, player);
-            printMoveResult(moveRes);
-            break;
-        }
-        if (lossCondition(player))
+        Game game = {};
+        game.level = level;
+        bool isRead;
+
+        if (hasExtension(fileData.cFileName, "bin"))
         {
-            lossUpdateAndPrint(player, moveRes);
-            break;
+            isRead = readBinaryMap(game, filePath, &arena);
         }
-        if (moveRes == INVALID_MOVE)
+        else
         {
-            continue;
+            std::ifstream mapFile(filePath);
+            isRead = readGame(game, mapFile, &arena);
         }
 
-        game.map.enemyPosition = findShortestPath(game.map, visitedCells, enemyMoves);
+        delete[] filePath;
 
-        if (isSamePosition(game.map.playerPosition, game.map.enemyPosition))
+        if (isRead)
         {
-            lossUpdateAndPrint(player, ENEMY_ENCOUNTER);
-            break;
+            game.mapId = getMapId(game.map);
+            levelMaps.push_back(std::move(game));
         }
-    }
+    } while (FindNextFileA(findHandle, &fileData));
 
-    deleteMap(game.map);
-    player.savedGamesPerLevel[game.level - 1].map.matrix = nullptr;
+    FindClose(findHandle);
+    delete[] strLevel;
 }
 
-void deleteSavedGames(Player& player)
+// Scans ../Maps once, so starting a level copies a parsed template instead of reading a file
+void loadMapCatalog(MapCatalog& catalog)
 {
-    for (size_t i = 0; i < player.level; i++)
+    for (size_t i = 0; i < MAX_LEVEL; i++)
     {
-        Game& savedGame = player.savedGamesPerLevel[i];
+        loadLevelMaps(i + 1, catalog.levelMaps[i], catalog.levelArenas[i]);
+    }
+}
 
-        if (savedGame.map.matrix == nullptr)
-        {
-            continue;
-        }
+// The new game shares the template's tiles and portals, which stay unchanged while the catalog exists
+Game startGameFromTemplate(const Game& gameTemplate)
+{
+    Game game = {};
+    game.totalCoins = gameTemplate.totalCoins;
+    game.level = gameTemplate.level;
+    game.mapId = gameTemplate.mapId;
 
-        deleteMap(savedGame.map);
-    }
+    copyMapLayout(game.map, gameTemplate.map);
+    game.map.sharesTiles = game.map.matrix != nullptr;
+
+    return game;
 }
 
-void logIn(Player& player)
+bool isSamePosition(const MapCoordinate& firstPosition, const MapCoordinate& secondPosition)
 {
-    while (!getPlayerByName(player.name, player))
-    {
-        std::cout << "Name does not exist!" << std::endl;
-        enterUsername(player);
-    }
+    return firstPosition.rowIdx == secondPosition.rowIdx
+        && firstPosition.colIdx == secondPosition.colIdx;
+}
+
+void printLeaderboardEntry(const LeaderboardEntry& entry)
+{
+    std::cout << entry.name << ": ";
+
+    std::cout << entry.level << " level; ";
+    std::cout << entry.coins << " coins; ";
+    std::cout << entry.lives << " lives";
+
+    std::cout << std::endl;
 }
 
-void signUp(Player& player)
+int compareDesc(int first, int second)
 {
-    while (!appendPlayerNameToFile(player.name))
+    if (first > second)
     {
-        std::cout << "Name already exists!" << std::endl;
-        enterUsername(player);
+        return -1;
     }
 
-    savePlayerProgress(player);
+    if (first < second)
+    {
+        return 1;
+    }
+
+    return 0;
 }
 
-void showLeaderboard(const Player& player)
+unsigned long long packRankField(unsigned long long key, int value, int bitsCount, bool isDescending)
 {
-    clearConsole();
-    size_t playerRank = 1;
-
-    std::vector<Player> allPlayers = getAllPlayers(player);
-    size_t playersCount = allPlayers.size();
-    sortPlayers(allPlayers, 0, playersCount - 1);
+    unsigned long long maxValue = (1ULL << bitsCount) - 1;
+    unsigned long long field = value < 0 ? 0 : value;
 
-    for (size_t i = 0; i < playersCount; i++)
+    if (field > maxValue)
     {
-        size_t currRank = i + 1;
-        if (strCompare(player.name, allPlayers[i].name) == 0)
-        {
-            playerRank = currRank;
-        }
+        field = maxValue;
+    }
 
-        std::cout << currRank << ". ";
-        printPlayerInfo(allPlayers[i]);
+    if (isDescending)
+    {
+        field = maxValue - field;
     }
 
-    std::cout << "You are number " << playerRank << " in the leaderboard" << std::endl;
+    return (key << bitsCount) | field;
 }
 
-void buyLives(Player& player)
+// Packs level, coins and lives so that a smaller key means a higher rank,
+// the slot in the lowest bits keeps players with equal results in sign-up order
+unsigned long long getRankKey(const LeaderboardEntry& entry, int slot)
 {
-    clearConsole();
+    unsigned long long key = 0;
+    key = packRankField(key, entry.level, RANK_KEY_LEVEL_BITS, true);
+    key = packRankField(key, entry.coins, RANK_KEY_COINS_BITS, true);
+    key = packRankField(key, entry.lives, RANK_KEY_LIVES_BITS, true);
+    key = packRankField(key, slot, RANK_KEY_SLOT_BITS, false);
 
-    const int returnToMenu = 0;
-    const int maxLivesToBuy = 100;
+    return key;
+}
 
-    int initialLives = player.lives;
-    int inputNum;
+int compareRanks(const Leaderboard& leaderboard, int firstSlot, int secondSlot)
+{
+    unsigned long long firstKey = leaderboard.keys[firstSlot];
+    unsigned long long secondKey = leaderboard.keys[secondSlot];
 
-    while (true)
+    if (firstKey != secondKey)
     {
-        std::cout << "One life costs " << LIFE_PRICE << " coins" << std::endl;
-        std::cout << "You have " << player.coins << " coins." << std::endl;
-        std::cout << "Enter the number of lives you want to buy or " << returnToMenu << " to return to menu:" << std::endl;
+        return firstKey < secondKey ? -1 : 1;
+    }
 
-        inputNum = getNumberInRange(returnToMenu, maxLivesToBuy);
-        clearConsole();
+    return compareDesc(secondSlot, firstSlot);
+}
 
-        if (inputNum == returnToMenu)
+// Stable LSD radix sort of the keys that moves the slots along with them
+void sortRankKeys(std::vector<unsigned long long>& keys, std::vector<int>& slots)
+{
+    const int digitsCount = 1 << RADIX_BITS;
+    const unsigned long long digitMask = digitsCount - 1;
+
+    size_t keysCount = keys.size();
+    std::vector<unsigned long long> sortedKeys(keysCount);
+    std::vector<int> sortedSlots(keysCount);
+
+    for (int shift = 0; shift < 64; shift += RADIX_BITS)
+    {
+        size_t counts[digitsCount] = {};
+
+        for (size_t i = 0; i < keysCount; i++)
         {
-            break;
+            counts[(keys[i] >> shift) & digitMask]++;
         }
 
-        int cost = inputNum * LIFE_PRICE;
-
-        if (player.coins < cost)
+        // All keys share this digit, so the pass would not move anything
+        if (keysCount == 0 || counts[(keys[0] >> shift) & digitMask] == keysCount)
         {
-            std::cout << "Not enough coins! You need " << cost << " coins to buy " << inputNum << " lives!" << std::endl;
             continue;
         }
 
-        std::cout << "You are about to buy " << inputNum << " lives for " << cost << " coins" << std::endl;
-        bool acceptToBuy = inputYesNo("Are you sure you want to make this purchase?");
-        clearConsole();
+        size_t position = 0;
+        for (int digit = 0; digit < digitsCount; digit++)
+        {
+            size_t count = counts[digit];
+            counts[digit] = position;
+            position += count;
+        }
 
-        if (acceptToBuy)
+        for (size_t i = 0; i < keysCount; i++)
         {
-            player.lives += inputNum;
-            player.coins -= cost;
-            break;
+            size_t target = counts[(keys[i] >> shift) & digitMask]++;
+            sortedKeys[target] = keys[i];
+            sortedSlots[target] = slots[i];
         }
+
+        keys.swap(sortedKeys);
+        slots.swap(sortedSlots);
     }
+}
 
-    if (player.lives > initialLives)
+int getRanksCount(const Leaderboard& leaderboard, int node)
+{
+    if (node == -1)
     {
-        std::cout << "You successfully bought " << player.lives - initialLives << " lives" << std::endl;
+        return 0;
     }
+
+    return leaderboard.nodes[node].size;
 }
 
-void displayPlayerInfo(const Player& player)
+void updateRanksCount(Leaderboard& leaderboard, int node)
 {
-    clearConsole();
+    RankNode& rankNode = leaderboard.nodes[node];
+    rankNode.size = 1 + getRanksCount(leaderboard, rankNode.left) + getRanksCount(leaderboard, rankNode.right);
+}
 
-    std::cout << "Name: " << player.name << std::endl;
-    std::cout << "Level: " << player.level << std::endl;
-    std::cout << "Lives: " << player.lives << std::endl;
-    std::cout << "Coins: " << player.coins << std::endl;
+// Splits the subtree into the nodes ranked before the given slot and all the rest
+void splitRanks(Leaderboard& leaderboard, int node, int slot, int& left, int& right)
+{
+    if (node == -1)
+    {
+        left = -1;
+        right = -1;
+        return;
+    }
+
+    RankNode& rankNode = leaderboard.nodes[node];
+
+    if (compareRanks(leaderboard, node, slot) < 0)
+    {
+        splitRanks(leaderboard, rankNode.right, slot, rankNode.right, right);
+        left = node;
+    }
+    else
+    {
+        splitRanks(leaderboard, rankNode.left, slot, left, rankNode.left);
+        right = node;
+    }
+
+    updateRanksCount(leaderboard, node);
 }
 
-void exit(Player& player)
+int mergeRanks(Leaderboard& leaderboard, int left, int right)
 {
-    savePlayerProgress(player);
-    deleteSavedGames(player);
+    if (left == -1)
+    {
+        return right;
+    }
+
+    if (right == -1)
+    {
+        return left;
+    }
+
+    RankNode& leftNode = leaderboard.nodes[left];
+    RankNode& rightNode = leaderboard.nodes[right];
+
+    if (leftNode.priority > rightNode.priority)
+    {
+        leftNode.right = mergeRanks(leaderboard, leftNode.right, right);
+        updateRanksCount(leaderboard, left);
+        return left;
+    }
+
+    rightNode.left = mergeRanks(leaderboard, left, rightNode.left);
+    updateRanksCount(leaderboard, right);
+    return right;
 }
 
-int displayMenuOptions()
+void insertRank(Leaderboard& leaderboard, int slot)
 {
-    int optionsCount = 0;
+    RankNode& rankNode = leaderboard.nodes[slot];
+    rankNode.size = 1;
+    rankNode.left = -1;
+    rankNode.right = -1;
 
-    std::cout << "Please enter one of the numbers below to choose an option:" << std::endl;
-    std::cout << ++optionsCount << ") " << "Play a game" << std::endl;
-    std::cout << ++optionsCount << ") " << "Buy lives" << std::endl;
-    std::cout << ++optionsCount << ") " << "View info" << std::endl;
-    std::cout << ++optionsCount << ") " << "View leaderboard" << std::endl;
-    std::cout << ++optionsCount << ") " << "Sign out" << std::endl;
-    std::cout << ++optionsCount << ") " << "Exit" << std::endl;
+    int left;
+    int right;
+    splitRanks(leaderboard, leaderboard.root, slot, left, right);
 
-    return optionsCount;
+    leaderboard.root = mergeRanks(leaderboard, mergeRanks(leaderboard, left, slot), right);
 }
 
-void pressKeyToContinue()
+int eraseRank(Leaderboard& leaderboard, int node, int slot)
 {
-    std::cout << "Press any key to return to menu" << std::endl;
+    if (node == -1)
+    {
+        return -1;
+    }
 
-    std::cin.get();
-    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    RankNode& rankNode = leaderboard.nodes[node];
 
-    clearConsole();
+    if (node == slot)
+    {
+        return mergeRanks(leaderboard, rankNode.left, rankNode.right);
+    }
+
+    if (compareRanks(leaderboard, slot, node) < 0)
+    {
+        rankNode.left = eraseRank(leaderboard, rankNode.left, slot);
+    }
+    else
+    {
+        rankNode.right = eraseRank(leaderboard, rankNode.right, slot);
+    }
+
+    updateRanksCount(leaderboard, node);
+    return node;
 }
 
-Player enterApp()
+int getRankPriority()
 {
-    Player player = {};
-    int optionNum = getInputOption();
+    return (rand() << 15) ^ rand();
+}
 
-    std::cin.ignore();
-    enterUsername(player);
+void addLeaderboardEntry(Leaderboard& leaderboard, const LeaderboardEntry& entry)
+{
+    int slot = leaderboard.entries.size();
+
+    RankNode rankNode;
+    rankNode.priority = getRankPriority();
+
+    leaderboard.entries.push_back(entry);
+    leaderboard.keys.push_back(getRankKey(entry, slot));
+    leaderboard.nodes.push_back(rankNode);
+
+    insertRank(leaderboard, slot);
+}
+
+int countSubtreeRanks(Leaderboard& leaderboard, int node)
+{
+    if (node == -1)
+    {
+        return 0;
+    }
+
+    RankNode& rankNode = leaderboard.nodes[node];
+    rankNode.size = 1 + countSubtreeRanks(leaderboard, rankNode.left) + countSubtreeRanks(leaderboard, rankNode.right);
+
+    return rankNode.size;
+}
 
-    if (optionNum == 1)
+// Builds the treap in linear time from the slots in rank order by keeping its right spine on a stack
+void buildRanks(Leaderboard& leaderboard, const std::vector<int>& rankedSlots)
+{
+    std::vector<int> rightSpine;
+
+    for (size_t i = 0; i < rankedSlots.size(); i++)
     {
-        logIn(player);
+        int slot = rankedSlots[i];
+        RankNode& rankNode = leaderboard.nodes[slot];
+        rankNode.left = -1;
+        rankNode.right = -1;
+
+        while (!rightSpine.empty() && leaderboard.nodes[rightSpine.back()].priority < rankNode.priority)
+        {
+            rankNode.left = rightSpine.back();
+            rightSpine.pop_back();
+        }
+
+        if (!rightSpine.empty())
+        {
+            leaderboard.nodes[rightSpine.back()].right = slot;
+        }
+
+        rightSpine.push_back(slot);
     }
-    else if (optionNum == 2)
+
+    leaderboard.root = rightSpine.empty() ? -1 : rightSpine.front();
+    countSubtreeRanks(leaderboard, leaderboard.root);
+}
+
+void loadLeaderboard(Leaderboard& leaderboard)
+{
+    leaderboard.entries = readPlayerRecords();
+
+    size_t entriesCount = leaderboard.entries.size();
+    leaderboard.keys.resize(entriesCount);
+    leaderboard.nodes.assign(entriesCount, RankNode());
+
+    std::vector<int> rankedSlots(entriesCount);
+
+    for (size_t i = 0; i < entriesCount; i++)
     {
-        signUp(player);
+        leaderboard.keys[i] = getRankKey(leaderboard.entries[i], i);
+        leaderboard.nodes[i].priority = getRankPriority();
+        rankedSlots[i] = i;
     }
 
-    clearConsole();
-    std::cout << "Welcome " << player.name << std::endl;
+    std::vector<unsigned long long> sortedKeys = leaderboard.keys;
+    sortRankKeys(sortedKeys, rankedSlots);
 
-    return player;
+    buildRanks(leaderboard, rankedSlots);
 }
 
-void signOut(Player& player)
+// Moves the current player's node only if the results changed since the last view
+void syncLeaderboardEntry(Leaderboard& leaderboard, Player& player)
 {
-    exit(player);
-    clearConsole();
-    std::cout << "You successfully signed out." << std::endl;
-    player = enterApp();
+    if (player.leaderboardSlot == -1)
+    {
+        updateLeaderboardEntry(player);
+    }
+
+    size_t slot = player.leaderboardSlot;
+
+    if (leaderboard.entries.empty() || slot > leaderboard.entries.size())
+    {
+        loadLeaderboard(leaderboard);
+    }
+
+    LeaderboardEntry entry;
+    fillLeaderboardEntry(player, entry);
+
+    if (slot == leaderboard.entries.size())
+    {
+        addLeaderboardEntry(leaderboard, entry);
+        return;
+    }
+
+    if (slot > leaderboard.entries.size())
+    {
+        return;
+    }
+
+    leaderboard.entries[slot] = entry;
+
+    unsigned long long key = getRankKey(entry, slot);
+    if (leaderboard.keys[slot] == key)
+    {
+        return;
+    }
+
+    leaderboard.root = eraseRank(leaderboard, leaderboard.root, slot);
+    leaderboard.keys[slot] = key;
+    insertRank(leaderboard, slot);
 }
 
-bool selectMenuOption(Player& player)
+size_t getLeaderboardRank(const Leaderboard& leaderboard, int slot)
 {
-    int optionsCount = displayMenuOptions();
-    int selectedOption = getNumberInRange(1, optionsCount);
+    size_t rank = 1;
+    int node = leaderboard.root;
 
-    switch (selectedOption)
+    while (node != -1)
     {
-    case 1:
+        const RankNode& rankNode = leaderboard.nodes[node];
+        int result = compareRanks(leaderboard, slot, node);
+
+        if (result == 0)
+        {
+            return rank + getRanksCount(leaderboard, rankNode.left);
+        }
+
+        if (result < 0)
+        {
+            node = rankNode.left;
+        }
+        else
+        {
+            rank += getRanksCount(leaderboard, rankNode.left) + 1;
+            node = rankNode.right;
+        }
+    }
+
+    return rank;
+}
+
+// Returns the slot of the player with the given rank or -1 if there is no such rank
+int getSlotByRank(const Leaderboard& leaderboard, size_t rank)
+{
+    int node = leaderboard.root;
+
+    while (node != -1)
     {
-        Game game = setUpGame(player);
-        playGame(game, player);
+        const RankNode& rankNode = leaderboard.nodes[node];
+        size_t leftCount = getRanksCount(leaderboard, rankNode.left);
+
+        if (rank == leftCount + 1)
+        {
+            return node;
+        }
+
+        if (rank <= leftCount)
+        {
+            node = rankNode.left;
+        }
+        else
+        {
+            rank -= leftCount + 1;
+            node = rankNode.right;
+        }
     }
-    break;
 
-    case 2:
-        buyLives(player);
-        break;
+    return -1;
+}
 
-    case 3:
-        displayPlayerInfo(player);
-        pressKeyToContinue();
-        break;
+void printLeaderboardPage(const Leaderboard& leaderboard, int page)
+{
+    size_t firstRank = (size_t)(page - 1) * LEADERBOARD_PAGE_SIZE + 1;
 
-    case 4:
-        showLeaderboard(player);
-        pressKeyToContinue();
-        break;
+    for (size_t rank = firstRank; rank < firstRank + LEADERBOARD_PAGE_SIZE; rank++)
+    {
+        int slot = getSlotByRank(leaderboard, rank);
+        if (slot == -1)
+        {
+            break;
+        }
 
-    case 5:
-        signOut(player);
-        break;
+        std::cout << rank << ". ";
+        printLeaderboardEntry(leaderboard.entries[slot]);
+    }
+}
 
-    case 6:
-        exit(player);
-        return false;
+const char* getMoveResultMessage(MoveResult moveRes)
+{
+    switch (moveRes)
+    {
+    case ENEMY_ENCOUNTER:
+        return "You were captured by enemy!";
+
+    case WALL_HIT:
+        return "Ouch! You hit a wall!";
+
+    case COIN_COLLECTED:
+        return "You collected a coin!";
+
+    case KEY_FOUND:
+        return "You found the key! Now find the treasure!";
+
+    case TELEPORTATION:
+        return "Whoosh! You teleported successfully!";
+
+    case TREASURE_WITHOUT_KEY:
+        return "You need a key to open the treasure!";
+
+    case TREASURE_WITH_KEY:
+        return "Congratulations! You win!";
+
+    default:
+        return nullptr;
+    }
+}
+
+void initFrame(Frame& frame, int rowsCount, int colsCount)
+{
+    frame.rowsCount = rowsCount;
+    frame.colsCount = colsCount;
+    frame.chars.assign(rowsCount * colsCount, SPACE);
+    frame.colors.assign(rowsCount * colsCount, DEFAULT_COLOR);
+}
+
+void putFrameChar(Frame& frame, int row, int col, char ch, char color)
+{
+    if (!isInRange(row, 0, frame.rowsCount - 1) || !isInRange(col, 0, frame.colsCount - 1))
+    {
+        return;
     }
 
-    return true;
+    frame.chars[row * frame.colsCount + col] = ch;
+    frame.colors[row * frame.colsCount + col] = color;
 }
 
-void run()
+// Returns the column right after the text
+int putFrameText(Frame& frame, int row, int col, const char* text)
 {
-    initRandom();
-    Player player = enterApp();
-    while (selectMenuOption(player));
+    for (; *text != '\0'; text++, col++)
+    {
+        putFrameChar(frame, row, col, *text, DEFAULT_COLOR);
+    }
+
+    return col;
+}
+
+int putFrameNumber(Frame& frame, int row, int col, int num)
+{
+    char* strNum = intToString(num);
+    col = putFrameText(frame, row, col, strNum);
+    delete[] strNum;
+
+    return col;
+}
+
+void getConsoleSize(int& rowsCount, int& colsCount)
+{
+    CONSOLE_SCREEN_BUFFER_INFO info;
+
+    if (!GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &info))
+    {
+        rowsCount = DEFAULT_CONSOLE_ROWS;
+        colsCount = DEFAULT_CONSOLE_COLS;
+        return;
+    }
+
+    rowsCount = info.srWindow.Bottom - info.srWindow.Top + 1;
+    colsCount = info.srWindow.Right - info.srWindow.Left + 1;
+}
+
+// Keeps the center in the middle of the visible range unless that would show cells outside the map
+int getViewportStart(int center, int visibleCount, int totalCount)
+{
+    int start = center - visibleCount / 2;
+
+    return std::max(0, std::min(start, totalCount - visibleCount));
 }
 
-int main()
+Viewport getViewport(const Map& map, int maxRows, int maxCols, bool isMinimap)
 {
+    Viewport viewport;
+    maxRows = std::max(maxRows, 1);
+    maxCols = std::max(maxCols, 1);
+
+    if (isMinimap)
+    {
+        viewport.blockRows = (map.rowsCount + maxRows - 1) / maxRows;
+        viewport.blockCols = (map.colsCount + maxCols - 1) / maxCols;
+        viewport.rowsCount = (map.rowsCount + viewport.blockRows - 1) / viewport.blockRows;
+        viewport.colsCount = (map.colsCount + viewport.blockCols - 1) / viewport.blockCols;
+
+        return viewport;
+    }
+
+    viewport.rowsCount = std::min(map.rowsCount, maxRows);
+    viewport.colsCount = std::min(map.colsCount, maxCols);
+    viewport.firstRow = getViewportStart(map.playerPosition.rowIdx, viewport.rowsCount, map.rowsCount);
+    viewport.firstCol = getViewportStart(map.playerPosition.colIdx, viewport.colsCount, map.colsCount);
+
+    return viewport;
+}
+
+// Returns whether the position falls into the block of the shown cell
+bool isInViewportCell(const Viewport& viewport, const MapCoordinate& position, int row, int col)
+{
+    int positionRow = position.rowIdx;
+    int positionCol = position.colIdx;
+    int blockRow = viewport.firstRow + row * viewport.blockRows;
+    int blockCol = viewport.firstCol + col * viewport.blockCols;
+
+    return isInRange(positionRow, blockRow, blockRow + viewport.blockRows - 1)
+        && isInRange(positionCol, blockCol, blockCol + viewport.blockCols - 1);
+}
+
+// Only the shown cells are read, a minimap block is represented by its middle tile
+void putMapView(Frame& frame, const Map& map, const Viewport& viewport, int startRow, int tileWidth)
+{
+    for (int i = 0; i < viewport.rowsCount; i++)
+    {
+        for (int j = 0; j < viewport.colsCount; j++)
+        {
+            int frameRow = startRow + i;
+            int frameCol = j * tileWidth;
+
+            if (isInViewportCell(viewport, map.playerPosition, i, j))
+            {
+                putFrameChar(frame, frameRow, frameCol, PLAYER, GREEN_COLOR);
+                continue;
+            }
+
+            if (isInViewportCell(viewport, map.enemyPosition, i, j))
+            {
+                putFrameChar(frame, frameRow, frameCol, ENEMY, RED_COLOR);
+                continue;
+            }
+
+            int tileRow = std::min(viewport.firstRow + i * viewport.blockRows + viewport.blockRows / 2, map.rowsCount - 1);
+            int tileCol = std::min(viewport.firstCol + j * viewport.blockCols + viewport.blockCols / 2, map.colsCount - 1);
+            MapCoordinate tilePosition = { (size_t)tileRow, (size_t)tileCol };
+
+            putFrameChar(frame, frameRow, frameCol, getTile(map, tilePosition), DEFAULT_COLOR);
+        }
+    }
+}
+
+// Lays out the game info, the visible part of the map, the last move's message and the rules.
+// The frame fits the console, so its size doesn't depend on the size of the map.
+void composeGameFrame(Frame& frame, const Game& game, int lives, MoveResult moveRes, bool isMinimapShown)
+{
+    const Map& map = game.map;
+    const int infoRowsCount = 4;
+    const int tileWidth = 3;
+    // Info, the empty rows around the map, the message, the rules, the input line and the line Enter
+    // moves to, which must not scroll the console
+    const int fixedRowsCount = infoRowsCount + 3 + MOVE_RULES_COUNT + 2;
+
+    int consoleRows;
+    int consoleCols;
+    getConsoleSize(consoleRows, consoleCols);
+
+    // The last console column is left free, so a full row doesn't wrap
+    Viewport viewport = getViewport(map, consoleRows - fixedRowsCount, (consoleCols - 1) / tileWidth, isMinimapShown);
+
+    int mapStartRow = infoRowsCount + 1;
+    int messageRow = mapStartRow + viewport.rowsCount + 1;
+
+    initFrame(frame, messageRow + 1 + MOVE_RULES_COUNT, std::max(viewport.colsCount * tileWidth, FRAME_TEXT_WIDTH));
+
+    int col = putFrameText(frame, 0, 0, "Level: ");
+    putFrameNumber(frame, 0, col, game.level);
+
+    col = putFrameText(frame, 1, 0, "Lives: ");
+    putFrameNumber(frame, 1, col, lives);
+
+    col = putFrameText(frame, 2, 0, "Coins: ");
+    col = putFrameNumber(frame, 2, col, game.coinsCollected);
+    col = putFrameText(frame, 2, col, "/");
+    putFrameNumber(frame, 2, col, game.totalCoins);
+
+    col = putFrameText(frame, 3, 0, "Key: ");
+    putFrameText(frame, 3, col, game.keyFound ? "Found" : "Not found");
+
+    putMapView(frame, map, viewport, mapStartRow, tileWidth);
+
+    const char* message = getMoveResultMessage(moveRes);
+    if (message != nullptr)
+    {
+        putFrameText(frame, messageRow, 0, message);
+    }
+
+    for (int i = 0; i < MOVE_RULES_COUNT; i++)
+    {
+        putFrameText(frame, messageRow + 1 + i, 0, MOVE_RULES[i]);
+    }
+}
+
+void appendOutput(std::vector<char>& output, const char* text)
+{
+    for (; *text != '\0'; text++)
+    {
+        output.push_back(*text);
+    }
+}
+
+void appendOutputNumber(std::vector<char>& output, int num)
+{
+    char* strNum = intToString(num);
+    appendOutput(output, strNum);
+    delete[] strNum;
+}
+
+// ANSI rows and columns are counted from 1
+void appendCursorMove(std::vector<char>& output, int row, int col)
+{
+    appendOutput(output, "\033[");
+    appendOutputNumber(output, row + 1);
+    output.push_back(';');
+    appendOutputNumber(output, col + 1);
+    output.push_back('H');
+}
+
+void appendColor(std::vector<char>& output, char color)
+{
+    appendOutput(output, "\033[");
+    appendOutputNumber(output, color);
+    output.push_back('m');
+}
+
+// Writes only the cells that differ from the frame on the console in one write, the whole frame
+// is drawn when its size changed. The cursor is left on the line under the frame for the input.
+void renderFrame(FrameRenderer& renderer)
+{
+    Frame& shown = renderer.shownFrame;
+    const Frame& next = renderer.nextFrame;
+    std::vector<char>& output = renderer.output;
+
+    bool isFullRedraw = shown.rowsCount != next.rowsCount || shown.colsCount != next.colsCount;
+    output.clear();
+
+    if (isFullRedraw)
+    {
+        appendOutput(output, "\033[H\033[2J");
+    }
+
+    char currColor = DEFAULT_COLOR;
+
+    for (int row = 0; row < next.rowsCount; row++)
+    {
+        bool isCursorPlaced = false;
+
+        for (int col = 0; col < next.colsCount; col++)
+        {
+            int cellIdx = row * next.colsCount + col;
+            char ch = next.chars[cellIdx];
+            char color = next.colors[cellIdx];
+
+            bool isChanged = isFullRedraw || shown.chars[cellIdx] != ch || shown.colors[cellIdx] != color;
+            if (!isChanged)
+            {
+                isCursorPlaced = false;
+                continue;
+            }
+
+            if (!isCursorPlaced)
+            {
+                appendCursorMove(output, row, col);
+                isCursorPlaced = true;
+            }
+
+            if (color != currColor)
+            {
+                appendColor(output, color);
+                currColor = color;
+            }
+
+            output.push_back(ch);
+        }
+    }
+
+    if (currColor != DEFAULT_COLOR)
+    {
+        appendColor(output, DEFAULT_COLOR);
+    }
+
+    // Clears whatever was typed after the previous frame
+    appendCursorMove(output, next.rowsCount, 0);
+    appendOutput(output, "\033[J");
+
+    std::cout.write(output.data(), output.size());
+    std::cout.flush();
+
+    shown = next;
+}
+
+int readNumber()
+{
+    int num;
+    std::cin >> num;
+
+    while (std::cin.fail())
+    {
+        std::cout << "Invalid input! Please enter a number." << std::endl;
+        std::cin.clear();
+        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        std::cin >> num;
+    }
+
+    return num;
+}
+
+int getNumberInRange(int from, int to)
+{
+    int num = readNumber();
+
+    while (!isInRange(num, from, to))
+    {
+        std::cout << "Invalid number! Please enter a number between " << from << " and " << to << std::endl;
+        num = readNumber();
+    }
+
+    return num;
+}
+
+int getInputOption()
+{
+    std::cout << "Please choose one of the following options:" << std::endl;
+    std::cout << "1) Log in" << std::endl;
+    std::cout << "2) Sign up" << std::endl;
+
+    int inputOption = getNumberInRange(1, 2);
+    return inputOption;
+}
+
+bool inputYesNo(const char* question)
+{
+    if (question == nullptr)
+    {
+        return false;
+    }
+
+    std::cout << question;
+    std::cout << " Enter one of the numbers below:" << std::endl;
+
+    const int YES = 1;
+    const int NO = 2;
+
+    std::cout << YES << ") Yes" << std::endl;
+    std::cout << NO << ") No" << std::endl;
+
+    int optionNumber = getNumberInRange(YES, NO);
+    return optionNumber == YES;
+}
+
+bool isValidCoordinate(const MapCoordinate& coordinate, int rows, int cols)
+{
+    return coordinate.rowIdx < rows && coordinate.colIdx < cols;
+}
+
+bool changePosition(MapCoordinate& pCoordinate, char playerMove)
+{
+    playerMove = toLower(playerMove);
+
+    switch (playerMove)
+    {
+    case UP:
+        pCoordinate.rowIdx--;
+        break;
+
+    case DOWN:
+        pCoordinate.rowIdx++;
+        break;
+
+    case LEFT:
+        pCoordinate.colIdx--;
+        break;
+
+    case RIGHT:
+        pCoordinate.colIdx++;
+        break;
+
+    default:
+        return false;
+    }
+
+    return true;
+}
+
+MapCoordinate findNextPortal(const Map& map, const MapCoordinate& currPortal)
+{
+    MapCoordinate nextPortal = {};
+
+    if (map.matrix == nullptr)
+    {
+        return nextPortal;
+    }
+
+    int exitIdx = getPortalExitIdx(map, getCellIndex(map, currPortal));
+
+    if (exitIdx != -1)
+    {
+        nextPortal = getCellCoordinate(map, exitIdx);
+    }
+
+    return nextPortal;
+}
+
+void startSearch(PathFinder& pathFinder, size_t cellsCount)
+{
+    if (pathFinder.visitedGenerations.size() < cellsCount)
+    {
+        pathFinder.visitedGenerations.resize(cellsCount, 0);
+        pathFinder.parents.resize(cellsCount);
+        pathFinder.costs.resize(cellsCount);
+        pathFinder.frontier.resize(cellsCount);
+    }
+
+    pathFinder.generation++;
+
+    // After a wrap-around old stamps could look current again, so they are reset once
+    if (pathFinder.generation == 0)
+    {
+        std::fill(pathFinder.visitedGenerations.begin(), pathFinder.visitedGenerations.end(), 0);
+        pathFinder.generation = 1;
+    }
+}
+
+bool isVisited(const PathFinder& pathFinder, int cellIdx)
+{
+    return pathFinder.visitedGenerations[cellIdx] == pathFinder.generation;
+}
+
+void markVisited(PathFinder& pathFinder, int cellIdx, int parentIdx)
+{
+    pathFinder.visitedGenerations[cellIdx] = pathFinder.generation;
+    pathFinder.parents[cellIdx] = parentIdx;
+}
+
+void clearEnemyRoute(EnemyRoute& route)
+{
+    route.cells.clear();
+    route.start = 0;
+    route.isShortest = true;
+    route.plannedDetour = 0;
+}
+
+void storeParentsRoute(PathFinder& pathFinder, int targetIdx)
+{
+    EnemyRoute& route = pathFinder.route;
+
+    clearEnemyRoute(route);
+
+    for (int cellIdx = targetIdx; cellIdx != -1; cellIdx = pathFinder.parents[cellIdx])
+    {
+        route.cells.push_back(cellIdx);
+    }
+
+    std::reverse(route.cells.begin(), route.cells.end());
+}
+
+MapCoordinate followEnemyRoute(const Map& map, EnemyRoute& route, size_t enemyStepsPerMove)
+{
+    route.start = std::min(route.start + enemyStepsPerMove, route.cells.size() - 1);
+
+    return getCellCoordinate(map, route.cells[route.start]);
+}
+
+// One bit per tile, indexed like the tiles themselves. The enemy only cares about walls,
+// so its searches test these bits instead of loading and comparing whole tiles.
+void buildPassabilityBitmap(const Map& map, PassabilityBitmap& bitmap)
+{
+    size_t cellsCount = getCellsCount(map);
+    size_t wordsCount = getWordsCount(cellsCount);
+
+    bitmap.passable.assign(wordsCount, 0);
+
+    for (size_t i = 0; i < cellsCount; i++)
+    {
+        if (map.matrix[i] != WALL)
+        {
+            setBit(bitmap.passable, i);
+        }
+    }
+}
+
+bool isValidEnemyMove(int cellIdx, const PassabilityBitmap& passability)
+{
+    return isBitSet(passability.passable, cellIdx);
+}
+
+int getEnemyNeighbourIdx(const Map& map, const PassabilityBitmap& passability, int cellIdx, size_t directionIdx)
+{
+    int newIdx = cellIdx + DIRECTIONS[directionIdx][0] * map.stride + DIRECTIONS[directionIdx][1];
+
+    if (!isValidEnemyMove(newIdx, passability))
+    {
+        return -1;
+    }
+
+    return newIdx;
+}
+
+// Labels the wall-connected regions, flooding every open cell once
+void labelComponents(const Map& map, MapPaths& paths)
+{
+    size_t cellsCount = getCellsCount(map);
+    int componentsCount = 0;
+    std::vector<int> frontier(cellsCount);
+
+    paths.components.assign(cellsCount, -1);
+
+    for (size_t rootIdx = 0; rootIdx < cellsCount; rootIdx++)
+    {
+        if (!isValidEnemyMove(rootIdx, paths.passability) || paths.components[rootIdx] != -1)
+        {
+            continue;
+        }
+
+        size_t frontierHead = 0;
+        size_t frontierTail = 0;
+
+        paths.components[rootIdx] = componentsCount;
+        frontier[frontierTail] = rootIdx;
+        frontierTail++;
+
+        while (frontierHead < frontierTail)
+        {
+            int currIdx = frontier[frontierHead];
+            frontierHead++;
+
+            for (size_t i = 0; i < DIRECTIONS_COUNT; i++)
+            {
+                int newIdx = getEnemyNeighbourIdx(map, paths.passability, currIdx, i);
+                if (newIdx == -1 || paths.components[newIdx] != -1)
+                {
+                    continue;
+                }
+
+                paths.components[newIdx] = componentsCount;
+                frontier[frontierTail] = newIdx;
+                frontierTail++;
+            }
+        }
+
+        componentsCount++;
+    }
+}
+
+// Fills the rows of the targets in [firstTarget, lastTarget) with a BFS from each target, a source
+// steps to the first neighbour one cell closer, the same choice as descending a distance field
+void buildNextHopRows(const Map& map, const PassabilityBitmap& passability, NextHopTable& table, size_t firstTarget, size_t lastTarget)
+{
+    size_t openCount = table.openCells.size();
+    std::vector<int> distances(openCount);
+    std::vector<int> frontier(openCount);
+
+    for (size_t target = firstTarget; target < lastTarget; target++)
+    {
+        std::fill(distances.begin(), distances.end(), -1);
+
+        size_t frontierHead = 0;
+        size_t frontierTail = 0;
+
+        distances[target] = 0;
+        frontier[frontierTail] = target;
+        frontierTail++;
+
+        while (frontierHead < frontierTail)
+        {
+            int curr = frontier[frontierHead];
+            frontierHead++;
+
+            for (size_t i = 0; i < DIRECTIONS_COUNT; i++)
+            {
+                int newIdx = getEnemyNeighbourIdx(map, passability, table.openCells[curr], i);
+                if (newIdx == -1 || distances[table.openNumbers[newIdx]] != -1)
+                {
+                    continue;
+                }
+
+                int next = table.openNumbers[newIdx];
+                distances[next] = distances[curr] + 1;
+                frontier[frontierTail] = next;
+                frontierTail++;
+            }
+        }
+
+        unsigned char* row = table.directions.data() + target * openCount;
+
+        for (size_t source = 0; source < openCount; source++)
+        {
+            row[source] = NO_NEXT_HOP;
+
+            if (distances[source] <= 0)
+            {
+                continue;
+            }
+
+            for (size_t i = 0; i < DIRECTIONS_COUNT; i++)
+            {
+                int newIdx = getEnemyNeighbourIdx(map, passability, table.openCells[source], i);
+                if (newIdx != -1 && distances[table.openNumbers[newIdx]] == distances[source] - 1)
+                {
+                    row[source] = (unsigned char)i;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+// The enemy's first step between every pair of open cells, maps over the budget get no table
+void buildNextHopTable(const Map& map, const PassabilityBitmap& passability, NextHopTable& table)
+{
+    size_t cellsCount = getCellsCount(map);
+
+    table.openCells.clear();
+    table.openNumbers.assign(cellsCount, -1);
+    table.directions.clear();
+
+    for (size_t i = 0; i < cellsCount; i++)
+    {
+        if (isValidEnemyMove(i, passability))
+        {
+            table.openNumbers[i] = table.openCells.size();
+            table.openCells.push_back(i);
+        }
+    }
+
+    size_t openCount = table.openCells.size();
+
+    if (openCount == 0 || openCount > NEXT_HOP_TABLE_BUDGET / openCount)
+    {
+        table.openCells.clear();
+        table.openNumbers.clear();
+        return;
+    }
+
+    table.directions.resize(openCount * openCount);
+
+    size_t workersCount = std::min((size_t)std::max(std::thread::hardware_concurrency(), 1u),
+        (openCount + NEXT_HOP_TARGETS_PER_WORKER - 1) / NEXT_HOP_TARGETS_PER_WORKER);
+
+    if (workersCount <= 1)
+    {
+        buildNextHopRows(map, passability, table, 0, openCount);
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    size_t targetsPerWorker = (openCount + workersCount - 1) / workersCount;
+
+    for (size_t firstTarget = 0; firstTarget < openCount; firstTarget += targetsPerWorker)
+    {
+        size_t lastTarget = std::min(firstTarget + targetsPerWorker, openCount);
+        workers.push_back(std::thread(buildNextHopRows, std::cref(map), std::cref(passability), std::ref(table), firstTarget, lastTarget));
+    }
+
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
+}
+
+MapCoordinate followNextHops(const Map& map, const NextHopTable& table, int enemyIdx, int playerIdx, size_t enemyStepsPerMove)
+{
+    size_t openCount = table.openCells.size();
+    const unsigned char* row = table.directions.data() + table.openNumbers[playerIdx] * openCount;
+    int currIdx = enemyIdx;
+
+    for (size_t step = 0; step < enemyStepsPerMove && currIdx != playerIdx; step++)
+    {
+        unsigned char directionIdx = row[table.openNumbers[currIdx]];
+        if (directionIdx == NO_NEXT_HOP)
+        {
+            break;
+        }
+
+        currIdx += DIRECTIONS[directionIdx][0] * map.stride + DIRECTIONS[directionIdx][1];
+    }
+
+    return getCellCoordinate(map, currIdx);
+}
+
+int getCellCluster(const Map& map, const ClusterGraph& graph, int cellIdx)
+{
+    int row = cellIdx / map.stride - 1;
+    int col = cellIdx % map.stride - 1;
+
+    return (row / CLUSTER_SIZE) * graph.clusterColsCount + col / CLUSTER_SIZE;
+}
+
+int getClusterLocalIdx(const Map& map, int cellIdx)
+{
+    int row = cellIdx / map.stride - 1;
+    int col = cellIdx % map.stride - 1;
+
+    return (row % CLUSTER_SIZE) * CLUSTER_SIZE + col % CLUSTER_SIZE;
+}
+
+// Distances from the source to the cells of its own cluster, without leaving the cluster. The frontier
+// holds positions inside the cluster, so staying in it is a bounds check.
+void floodCluster(const Map& map, const PassabilityBitmap& passability, const ClusterGraph& graph, int sourceIdx,
+    std::vector<int>& distances, std::vector<int>& frontier)
+{
+    int clusterIdx = getCellCluster(map, graph, sourceIdx);
+    int firstRow = (clusterIdx / graph.clusterColsCount) * CLUSTER_SIZE;
+    int firstCol = (clusterIdx % graph.clusterColsCount) * CLUSTER_SIZE;
+    int rowsCount = std::min(CLUSTER_SIZE, map.rowsCount - firstRow);
+    int colsCount = std::min(CLUSTER_SIZE, map.colsCount - firstCol);
+    int firstCellIdx = (firstRow + 1) * map.stride + firstCol + 1;
+    size_t frontierHead = 0;
+    size_t frontierTail = 0;
+
+    std::fill(distances.begin(), distances.end(), -1);
+    distances[getClusterLocalIdx(map, sourceIdx)] = 0;
+    frontier[frontierTail] = getClusterLocalIdx(map, sourceIdx);
+    frontierTail++;
+
+    while (frontierHead < frontierTail)
+    {
+        int currLocalIdx = frontier[frontierHead];
+        frontierHead++;
+
+        int row = currLocalIdx / CLUSTER_SIZE;
+        int col = currLocalIdx % CLUSTER_SIZE;
+
+        for (size_t i = 0; i < DIRECTIONS_COUNT; i++)
+        {
+            int newRow = row + DIRECTIONS[i][0];
+            int newCol = col + DIRECTIONS[i][1];
+
+            if (!isInRange(newRow, 0, rowsCount - 1) || !isInRange(newCol, 0, colsCount - 1))
+            {
+                continue;
+            }
+
+            int newLocalIdx = newRow * CLUSTER_SIZE + newCol;
+            if (distances[newLocalIdx] != -1 || !isValidEnemyMove(firstCellIdx + newRow * map.stride + newCol, passability))
+            {
+                continue;
+            }
+
+            distances[newLocalIdx] = distances[currLocalIdx] + 1;
+            frontier[frontierTail] = newLocalIdx;
+            frontierTail++;
+        }
+    }
+}
+
+void addClusterEntrance(std::vector<int>& entrances, int cellIdx)
+{
+    if (std::find(entrances.begin(), entrances.end(), cellIdx) == entrances.end())
+    {
+        entrances.push_back(cellIdx);
+    }
+}
+
+void addEntrancePair(const Map& map, const ClusterGraph& graph, int cellIdx, int crossStep,
+    std::vector<std::vector<int>>& clusterEntrances, std::vector<int>& crossings)
+{
+    int facingIdx = cellIdx + crossStep;
+
+    addClusterEntrance(clusterEntrances[getCellCluster(map, graph, cellIdx)], cellIdx);
+    addClusterEntrance(clusterEntrances[getCellCluster(map, graph, facingIdx)], facingIdx);
+    crossings.push_back(cellIdx);
+    crossings.push_back(facingIdx);
+}
+
+// Walks length cells of one border side from firstIdx, a cell and the one crossStep away form an open pair
+void addBorderEntrances(const Map& map, const PassabilityBitmap& passability, const ClusterGraph& graph, int firstIdx,
+    int step, int crossStep, int length, std::vector<std::vector<int>>& clusterEntrances, std::vector<int>& crossings)
+{
+    int runStart = -1;
+
+    for (int i = 0; i <= length; i++)
+    {
+        int cellIdx = firstIdx + i * step;
+        bool isOpenPair = i < length
+            && isValidEnemyMove(cellIdx, passability)
+            && isValidEnemyMove(cellIdx + crossStep, passability);
+
+        if (isOpenPair)
+        {
+            if (runStart == -1)
+            {
+                runStart = i;
+            }
+
+            continue;
+        }
+
+        if (runStart == -1)
+        {
+            continue;
+        }
+
+        int runLength = i - runStart;
+
+        if (runLength < ENTRANCE_SPLIT_LENGTH)
+        {
+            addEntrancePair(map, graph, firstIdx + (runStart + runLength / 2) * step, crossStep, clusterEntrances, crossings);
+        }
+        else
+        {
+            addEntrancePair(map, graph, firstIdx + runStart * step, crossStep, clusterEntrances, crossings);
+            addEntrancePair(map, graph, firstIdx + (i - 1) * step, crossStep, clusterEntrances, crossings);
+        }
+
+        runStart = -1;
+    }
+}
+
+int findClusterEntrance(const Map& map, const ClusterGraph& graph, int cellIdx)
+{
+    int clusterIdx = getCellCluster(map, graph, cellIdx);
+
+    for (int i = graph.entranceOffsets[clusterIdx]; i < graph.entranceOffsets[clusterIdx + 1]; i++)
+    {
+        if (graph.entranceCells[i] == cellIdx)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// Fills the distance matrices of the clusters in [firstCluster, lastCluster) with a flood from each entrance
+void buildClusterDistances(const Map& map, const PassabilityBitmap& passability, ClusterGraph& graph, size_t firstCluster, size_t lastCluster)
+{
+    std::vector<int> distances(CLUSTER_SIZE * CLUSTER_SIZE);
+    std::vector<int> frontier(CLUSTER_SIZE * CLUSTER_SIZE);
+
+    for (size_t clusterIdx = firstCluster; clusterIdx < lastCluster; clusterIdx++)
+    {
+        int firstEntrance = graph.entranceOffsets[clusterIdx];
+        int entrancesCount = graph.entranceOffsets[clusterIdx + 1] - firstEntrance;
+
+        for (int i = 0; i < entrancesCount; i++)
+        {
+            floodCluster(map, passability, graph, graph.entranceCells[firstEntrance + i], distances, frontier);
+
+            int* row = graph.distances.data() + graph.distanceOffsets[clusterIdx] + i * entrancesCount;
+
+            for (int j = 0; j < entrancesCount; j++)
+            {
+                row[j] = distances[getClusterLocalIdx(map, graph.entranceCells[firstEntrance + j])];
+            }
+        }
+    }
+}
+
+// Built once per map, the precomputation is a flood of one cluster per entrance. A plan then only
+// floods the clusters of the enemy and the player and searches the entrances in between.
+void buildClusterGraph(const Map& map, const PassabilityBitmap& passability, ClusterGraph& graph)
+{
+    graph.clusterRowsCount = (map.rowsCount + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+    graph.clusterColsCount = (map.colsCount + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+
+    size_t clustersCount = graph.clusterRowsCount * graph.clusterColsCount;
+    std::vector<std::vector<int>> clusterEntrances(clustersCount);
+    std::vector<int> crossings;
+
+    for (int clusterRow = 0; clusterRow < graph.clusterRowsCount; clusterRow++)
+    {
+        for (int clusterCol = 0; clusterCol < graph.clusterColsCount; clusterCol++)
+        {
+            int firstRow = 1 + clusterRow * CLUSTER_SIZE;
+            int firstCol = 1 + clusterCol * CLUSTER_SIZE;
+            int rowsCount = std::min(CLUSTER_SIZE, map.rowsCount - clusterRow * CLUSTER_SIZE);
+            int colsCount = std::min(CLUSTER_SIZE, map.colsCount - clusterCol * CLUSTER_SIZE);
+
+            // Only the right and bottom borders, the others are walked from the neighbouring clusters
+            if (clusterCol + 1 < graph.clusterColsCount)
+            {
+                addBorderEntrances(map, passability, graph, firstRow * map.stride + firstCol + colsCount - 1,
+                    map.stride, 1, rowsCount, clusterEntrances, crossings);
+            }
+
+            if (clusterRow + 1 < graph.clusterRowsCount)
+            {
+                addBorderEntrances(map, passability, graph, (firstRow + rowsCount - 1) * map.stride + firstCol,
+                    1, map.stride, colsCount, clusterEntrances, crossings);
+            }
+        }
+    }
+
+    graph.entranceOffsets.assign(clustersCount + 1, 0);
+    graph.distanceOffsets.assign(clustersCount + 1, 0);
+    graph.entranceCells.clear();
+
+    for (size_t i = 0; i < clustersCount; i++)
+    {
+        int entrancesCount = clusterEntrances[i].size();
+
+        graph.entranceOffsets[i + 1] = graph.entranceOffsets[i] + entrancesCount;
+        graph.distanceOffsets[i + 1] = graph.distanceOffsets[i] + entrancesCount * entrancesCount;
+        graph.entranceCells.insert(graph.entranceCells.end(), clusterEntrances[i].begin(), clusterEntrances[i].end());
+    }
+
+    size_t entrancesCount = graph.entranceCells.size();
+    std::vector<int> crossingEntrances(crossings.size());
+
+    graph.crossingOffsets.assign(entrancesCount + 1, 0);
+
+    for (size_t i = 0; i < crossings.size(); i++)
+    {
+        crossingEntrances[i] = findClusterEntrance(map, graph, crossings[i]);
+        graph.crossingOffsets[crossingEntrances[i] + 1]++;
+    }
+
+    for (size_t i = 0; i < entrancesCount; i++)
+    {
+        graph.crossingOffsets[i + 1] += graph.crossingOffsets[i];
+    }
+
+    std::vector<int> crossingsFilled(graph.crossingOffsets.begin(), graph.crossingOffsets.end() - 1);
+    graph.crossingTargets.resize(crossings.size());
+
+    for (size_t i = 0; i < crossings.size(); i += 2)
+    {
+        int firstEntrance = crossingEntrances[i];
+        int secondEntrance = crossingEntrances[i + 1];
+
+        graph.crossingTargets[crossingsFilled[firstEntrance]] = secondEntrance;
+        crossingsFilled[firstEntrance]++;
+        graph.crossingTargets[crossingsFilled[secondEntrance]] = firstEntrance;
+        crossingsFilled[secondEntrance]++;
+    }
+
+    graph.distances.assign(graph.distanceOffsets[clustersCount], -1);
+
+    size_t workersCount = std::min((size_t)std::max(std::thread::hardware_concurrency(), 1u),
+        (clustersCount + CLUSTERS_PER_WORKER - 1) / CLUSTERS_PER_WORKER);
+
+    if (workersCount <= 1)
+    {
+        buildClusterDistances(map, passability, graph, 0, clustersCount);
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    size_t clustersPerWorker = (clustersCount + workersCount - 1) / workersCount;
+
+    for (size_t firstCluster = 0; firstCluster < clustersCount; firstCluster += clustersPerWorker)
+    {
+        size_t lastCluster = std::min(firstCluster + clustersPerWorker, clustersCount);
+        workers.push_back(std::thread(buildClusterDistances, std::cref(map), std::cref(passability), std::ref(graph), firstCluster, lastCluster));
+    }
+
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
+}
+
+void buildMapPaths(const Map& map, MapPaths& paths)
+{
+    buildPassabilityBitmap(map, paths.passability);
+    labelComponents(map, paths);
+    buildNextHopTable(map, paths.passability, paths.nextHops);
+
+    if (paths.nextHops.directions.empty() && (size_t)getCellsCount(map) >= CLUSTER_GRAPH_MIN_CELLS)
+    {
+        buildClusterGraph(map, paths.passability, paths.clusterGraph);
+    }
+}
+
+// Done once at startup, so starting a game neither floods its map nor rebuilds its next hop table or cluster graph
+void buildCatalogPaths(MapCatalog& catalog)
+{
+    for (size_t level = 0; level < MAX_LEVEL; level++)
+    {
+        std::vector<Game>& levelMaps = catalog.levelMaps[level];
+
+        for (size_t i = 0; i < levelMaps.size(); i++)
+        {
+            catalog.levelPaths[level].emplace_back();
+            buildMapPaths(levelMaps[i].map, catalog.levelPaths[level].back());
+            levelMaps[i].map.paths = &catalog.levelPaths[level].back();
+        }
+    }
+}
+
+void preparePathFinder(const Map& map, PathFinder& pathFinder)
+{
+    pathFinder.paths = map.paths;
+
+    if (pathFinder.paths == nullptr)
+    {
+        buildMapPaths(map, pathFinder.ownPaths);
+        pathFinder.paths = &pathFinder.ownPaths;
+    }
+
+    clearEnemyRoute(pathFinder.route);
+    // Sized for the whole map up front, so no move pays for growing the search buffers
+    startSearch(pathFinder, getCellsCount(map));
+
+    if (!pathFinder.paths->clusterGraph.entranceOffsets.empty())
+    {
+        pathFinder.goalDistances.resize(CLUSTER_SIZE * CLUSTER_SIZE);
+        pathFinder.clusterDistances.resize(CLUSTER_SIZE * CLUSTER_SIZE);
+        pathFinder.clusterFrontier.resize(CLUSTER_SIZE * CLUSTER_SIZE);
+        pathFinder.waypoints.reserve(pathFinder.paths->clusterGraph.entranceCells.size() + 2);
+    }
+}
+
+void buildDistanceField(const Map& map, PathFinder& pathFinder, int rootIdx)
+{
+    DistanceField& field = pathFinder.distanceField;
+    const PassabilityBitmap& passability = pathFinder.paths->passability;
+    size_t cellsCount = getCellsCount(map);
+
+    startSearch(pathFinder, cellsCount);
+    field.distances.assign(cellsCount, -1);
+    field.rootIdx = rootIdx;
+    field.repairCost = 0;
+
+    size_t frontierHead = 0;
+    size_t frontierTail = 0;
+
+    field.distances[rootIdx] = 0;
+    pathFinder.frontier[frontierTail] = rootIdx;
+    frontierTail++;
+
+    while (frontierHead < frontierTail)
+    {
+        int currIdx = pathFinder.frontier[frontierHead];
+        frontierHead++;
+
+        for (size_t i = 0; i < DIRECTIONS_COUNT; i++)
+        {
+            int newIdx = getEnemyNeighbourIdx(map, passability, currIdx, i);
+            if (newIdx == -1 || field.distances[newIdx] != -1)
+            {
+                continue;
+            }
+
+            field.distances[newIdx] = field.distances[currIdx] + 1;
+            pathFinder.frontier[frontierTail] = newIdx;
+            frontierTail++;
+        }
+    }
+}
+
+void storeFieldRoute(const Map& map, PathFinder& pathFinder, int enemyIdx)
+{
+    const DistanceField& field = pathFinder.distanceField;
+    EnemyRoute& route = pathFinder.route;
+    int currIdx = enemyIdx;
+
+    clearEnemyRoute(route);
+    route.cells.push_back(currIdx);
+
+    while (currIdx != field.rootIdx)
+    {
+        for (size_t i = 0; i < DIRECTIONS_COUNT; i++)
+        {
+            int newIdx = getEnemyNeighbourIdx(map, pathFinder.paths->passability, currIdx, i);
+            if (newIdx != -1 && field.distances[newIdx] == field.distances[currIdx] - 1)
+            {
+                currIdx = newIdx;
+                break;
+            }
+        }
+
+        route.cells.push_back(currIdx);
+    }
+}
+
+// A lower bound of the distance to the target, valid wherever the field is rooted (triangle inequality)
+int getFieldHeuristic(const DistanceField& field, int cellIdx, int targetIdx)
+{
+    int difference = field.distances[cellIdx] - field.distances[targetIdx];
+    if (difference < 0)
+    {
+        return -difference;
+    }
+
+    return difference;
+}
+
+bool isWorseSearchNode(const SearchNode& first, const SearchNode& second)
+{
+    if (first.priority != second.priority)
+    {
+        return first.priority > second.priority;
+    }
+
+    return first.cost < second.cost;
+}
+
+void pushSearchNode(PathFinder& pathFinder, int cellIdx, int parentIdx, int cost, int heuristic)
+{
+    markVisited(pathFinder, cellIdx, parentIdx);
+    pathFinder.costs[cellIdx] = cost;
+
+    pathFinder.openNodes.push_back({ cost + heuristic, cost, cellIdx });
+    std::push_heap(pathFinder.openNodes.begin(), pathFinder.openNodes.end(), isWorseSearchNode);
+}
+
+bool repairDistanceField(const Map& map, PathFinder& pathFinder, int enemyIdx, int playerIdx)
+{
+    DistanceField& field = pathFinder.distanceField;
+
+    startSearch(pathFinder, getCellsCount(map));
+    pathFinder.openNodes.clear();
+    pushSearchNode(pathFinder, enemyIdx, -1, 0, getFieldHeuristic(field, enemyIdx, playerIdx));
+
+    while (!pathFinder.openNodes.empty())
+    {
+        std::pop_heap(pathFinder.openNodes.begin(), pathFinder.openNodes.end(), isWorseSearchNode);
+        SearchNode currNode = pathFinder.openNodes.back();
+        pathFinder.openNodes.pop_back();
+
+        if (currNode.cost != pathFinder.costs[currNode.cellIdx])
+        {
+            continue;
+        }
+
+        if (currNode.cellIdx == playerIdx)
+        {
+            return true;
+        }
+
+        field.repairCost++;
+
+        for (size_t i = 0; i < DIRECTIONS_COUNT; i++)
+        {
+            int newIdx = getEnemyNeighbourIdx(map, pathFinder.paths->passability, currNode.cellIdx, i);
+            if (newIdx == -1)
+            {
+                continue;
+            }
+
+            int newCost = currNode.cost + 1;
+            if (isVisited(pathFinder, newIdx) && pathFinder.costs[newIdx] <= newCost)
+            {
+                continue;
+            }
+
+            pushSearchNode(pathFinder, newIdx, currNode.cellIdx, newCost, getFieldHeuristic(field, newIdx, playerIdx));
+        }
+    }
+
+    return false;
+}
+
+int getManhattanDistance(const Map& map, int firstIdx, int secondIdx)
+{
+    int rowsDifference = firstIdx / map.stride - secondIdx / map.stride;
+    int colsDifference = firstIdx % map.stride - secondIdx % map.stride;
+
+    return std::abs(rowsDifference) + std::abs(colsDifference);
+}
+
+// Searches from the enemy towards the player, the Manhattan distance never overestimates on a 4-connected grid.
+// With maxCost set, paths longer than it are not looked for.
+bool findAStarPath(const Map& map, PathFinder& pathFinder, int enemyIdx, int playerIdx, int maxCost = -1)
+{
+    startSearch(pathFinder, getCellsCount(map));
+    pathFinder.openNodes.clear();
+    pushSearchNode(pathFinder, enemyIdx, -1, 0, getManhattanDistance(map, enemyIdx, playerIdx));
+
+    while (!pathFinder.openNodes.empty())
+    {
+        std::pop_heap(pathFinder.openNodes.begin(), pathFinder.openNodes.end(), isWorseSearchNode);
+        SearchNode currNode = pathFinder.openNodes.back();
+        pathFinder.openNodes.pop_back();
+
+        if (currNode.cost != pathFinder.costs[currNode.cellIdx])
+        {
+            continue;
+        }
+
+        if (currNode.cellIdx == playerIdx)
+        {
+            return true;
+        }
+
+        for (size_t i = 0; i < DIRECTIONS_COUNT; i++)
+        {
+            int newIdx = getEnemyNeighbourIdx(map, pathFinder.paths->passability, currNode.cellIdx, i);
+            if (newIdx == -1)
+            {
+                continue;
+            }
+
+            int newCost = currNode.cost + 1;
+            if (isVisited(pathFinder, newIdx) && pathFinder.costs[newIdx] <= newCost)
+            {
+                continue;
+            }
+
+            int heuristic = getManhattanDistance(map, newIdx, playerIdx);
+            if (maxCost != -1 && newCost + heuristic > maxCost)
+            {
+                continue;
+            }
+
+            pushSearchNode(pathFinder, newIdx, currNode.cellIdx, newCost, heuristic);
+        }
+    }
+
+    return false;
+}
+
+bool isOpenCell(const PathFinder& pathFinder, int cellIdx)
+{
+    return isValidEnemyMove(cellIdx, pathFinder.paths->passability);
+}
+
+// Follows a column until the target or a cell where a shortest path may have to turn: a side
+// cell that is open while the one behind it is a wall can't be reached by turning earlier
+int jumpVertically(const PathFinder& pathFinder, int cellIdx, int rowStep, int targetIdx)
+{
+    while (true)
+    {
+        int nextIdx = cellIdx + rowStep;
+
+        if (!isOpenCell(pathFinder, nextIdx))
+        {
+            return -1;
+        }
+
+        if (nextIdx == targetIdx)
+        {
+            return nextIdx;
+        }
+
+        if ((isOpenCell(pathFinder, nextIdx - 1) && !isOpenCell(pathFinder, cellIdx - 1))
+            || (isOpenCell(pathFinder, nextIdx + 1) && !isOpenCell(pathFinder, cellIdx + 1)))
+        {
+            return nextIdx;
+        }
+
+        cellIdx = nextIdx;
+    }
+}
+
+// Rows are followed first and columns branch off them, so a row cell is a jump point when a
+// vertical jump from it finds one
+int jumpHorizontally(const PathFinder& pathFinder, int cellIdx, int colStep, int rowStep, int targetIdx)
+{
+    while (true)
+    {
+        int nextIdx = cellIdx + colStep;
+
+        if (!isOpenCell(pathFinder, nextIdx))
+        {
+            return -1;
+        }
+
+        if (nextIdx == targetIdx
+            || jumpVertically(pathFinder, nextIdx, rowStep, targetIdx) != -1
+            || jumpVertically(pathFinder, nextIdx, -rowStep, targetIdx) != -1)
+        {
+            return nextIdx;
+        }
+
+        cellIdx = nextIdx;
+    }
+}
+
+void pushJumpPoint(PathFinder& pathFinder, const Map& map, int jumpIdx, int parentIdx, int parentCost, int targetIdx)
+{
+    if (jumpIdx == -1)
+    {
+        return;
+    }
+
+    int newCost = parentCost + getManhattanDistance(map, jumpIdx, parentIdx);
+    if (isVisited(pathFinder, jumpIdx) && pathFinder.costs[jumpIdx] <= newCost)
+    {
+        return;
+    }
+
+    pushSearchNode(pathFinder, jumpIdx, parentIdx, newCost, getManhattanDistance(map, jumpIdx, targetIdx));
+}
+
+// A* over jump points only. A node reached along a row may go on or turn into either column,
+// a node reached along a column goes on and turns only where the cell behind a side is a wall.
+bool findJumpPointPath(const Map& map, PathFinder& pathFinder, int enemyIdx, int playerIdx)
+{
+    startSearch(pathFinder, getCellsCount(map));
+    pathFinder.openNodes.clear();
+    pushSearchNode(pathFinder, enemyIdx, -1, 0, getManhattanDistance(map, enemyIdx, playerIdx));
+
+    int rowStep = map.stride;
+
+    while (!pathFinder.openNodes.empty())
+    {
+        std::pop_heap(pathFinder.openNodes.begin(), pathFinder.openNodes.end(), isWorseSearchNode);
+        SearchNode currNode = pathFinder.openNodes.back();
+        pathFinder.openNodes.pop_back();
+
+        int currIdx = currNode.cellIdx;
+
+        if (currNode.cost != pathFinder.costs[currIdx])
+        {
+            continue;
+        }
+
+        if (currIdx == playerIdx)
+        {
+            return true;
+        }
+
+        int parentIdx = pathFinder.parents[currIdx];
+        bool isFromRow = parentIdx != -1 && parentIdx / rowStep == currIdx / rowStep;
+        bool isFromColumn = parentIdx != -1 && !isFromRow;
+
+        if (!isFromColumn)
+        {
+            int colSteps[] = { 1, -1 };
+
+            for (size_t i = 0; i < 2; i++)
+            {
+                // A row is never walked back the way it came
+                if (isFromRow && (currIdx - parentIdx) * colSteps[i] < 0)
+                {
+                    continue;
+                }
+
+                pushJumpPoint(pathFinder, map, jumpHorizontally(pathFinder, currIdx, colSteps[i], rowStep, playerIdx),
+                    currIdx, currNode.cost, playerIdx);
+            }
+        }
+
+        int rowSteps[] = { rowStep, -rowStep };
+
+        for (size_t i = 0; i < 2; i++)
+        {
+            if (isFromColumn && (currIdx - parentIdx) * rowSteps[i] < 0)
+            {
+                continue;
+            }
+
+            pushJumpPoint(pathFinder, map, jumpVertically(pathFinder, currIdx, rowSteps[i], playerIdx),
+                currIdx, currNode.cost, playerIdx);
+        }
+
+        if (isFromColumn)
+        {
+            int colSteps[] = { 1, -1 };
+            int prevIdx = currIdx - (currIdx - parentIdx) / getManhattanDistance(map, currIdx, parentIdx);
+
+            for (size_t i = 0; i < 2; i++)
+            {
+                // Forced turn: the side cell can't be reached through the column cell behind this one
+                if (isOpenCell(pathFinder, currIdx + colSteps[i]) && !isOpenCell(pathFinder, prevIdx + colSteps[i]))
+                {
+                    pushJumpPoint(pathFinder, map, jumpHorizontally(pathFinder, currIdx, colSteps[i], rowStep, playerIdx),
+                        currIdx, currNode.cost, playerIdx);
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+// Jump points on a path are joined by straight segments, which are filled in cell by cell
+void storeJumpRoute(const Map& map, PathFinder& pathFinder, int targetIdx)
+{
+    EnemyRoute& route = pathFinder.route;
+    std::vector<int>& jumpPoints = pathFinder.jumpPoints;
+
+    jumpPoints.clear();
+
+    for (int cellIdx = targetIdx; cellIdx != -1; cellIdx = pathFinder.parents[cellIdx])
+    {
+        jumpPoints.push_back(cellIdx);
+    }
+
+    int currIdx = jumpPoints.back();
+
+    clearEnemyRoute(route);
+    route.cells.push_back(currIdx);
+
+    for (size_t i = jumpPoints.size() - 1; i > 0; i--)
+    {
+        int nextIdx = jumpPoints[i - 1];
+        int step = (nextIdx - currIdx) / getManhattanDistance(map, currIdx, nextIdx);
+
+        while (currIdx != nextIdx)
+        {
+            currIdx += step;
+            route.cells.push_back(currIdx);
+        }
+    }
+}
+
+void pushClusterNode(const Map& map, PathFinder& pathFinder, int node, int cellIdx, int parentNode, int cost, int playerIdx, int maxCost)
+{
+    if (isVisited(pathFinder, node) && pathFinder.costs[node] <= cost)
+    {
+        return;
+    }
+
+    int heuristic = getManhattanDistance(map, cellIdx, playerIdx);
+    if (maxCost != -1 && cost + heuristic > maxCost)
+    {
+        return;
+    }
+
+    pushSearchNode(pathFinder, node, parentNode, cost, heuristic);
+}
+
+// A* over the entrances with the enemy and the player as two extra nodes linked to the entrances of
+// their clusters. The search reuses the cell buffers, there are fewer nodes than cells.
+// With maxCost set, paths longer than it are not looked for.
+bool findClusterPath(const Map& map, PathFinder& pathFinder, int enemyIdx, int playerIdx, int maxCost = -1)
+{
+    const ClusterGraph& graph = pathFinder.paths->clusterGraph;
+    std::vector<int>& waypoints = pathFinder.waypoints;
+    int entrancesCount = graph.entranceCells.size();
+    int enemyNode = entrancesCount;
+    int playerNode = entrancesCount + 1;
+    int enemyCluster = getCellCluster(map, graph, enemyIdx);
+    int playerCluster = getCellCluster(map, graph, playerIdx);
+
+    floodCluster(map, pathFinder.paths->passability, graph, playerIdx, pathFinder.goalDistances, pathFinder.clusterFrontier);
+
+    startSearch(pathFinder, entrancesCount + 2);
+    pathFinder.openNodes.clear();
+    pushSearchNode(pathFinder, enemyNode, -1, 0, getManhattanDistance(map, enemyIdx, playerIdx));
+
+    while (!pathFinder.openNodes.empty())
+    {
+        std::pop_heap(pathFinder.openNodes.begin(), pathFinder.openNodes.end(), isWorseSearchNode);
+        SearchNode currNode = pathFinder.openNodes.back();
+        pathFinder.openNodes.pop_back();
+
+        int currNodeIdx = currNode.cellIdx;
+
+        if (currNode.cost != pathFinder.costs[currNodeIdx])
+        {
+            continue;
+        }
+
+        if (currNodeIdx == playerNode)
+        {
+            break;
+        }
+
+        int currIdx = enemyIdx;
+        int clusterIdx = enemyCluster;
+
+        if (currNodeIdx == enemyNode)
+        {
+            floodCluster(map, pathFinder.paths->passability, graph, enemyIdx, pathFinder.clusterDistances, pathFinder.clusterFrontier);
+
+            for (int i = graph.entranceOffsets[enemyCluster]; i < graph.entranceOffsets[enemyCluster + 1]; i++)
+            {
+                int distance = pathFinder.clusterDistances[getClusterLocalIdx(map, graph.entranceCells[i])];
+                if (distance != -1)
+                {
+                    pushClusterNode(map, pathFinder, i, graph.entranceCells[i], currNodeIdx, currNode.cost + distance, playerIdx, maxCost);
+                }
+            }
+        }
+        else
+        {
+            currIdx = graph.entranceCells[currNodeIdx];
+            clusterIdx = getCellCluster(map, graph, currIdx);
+
+            int firstEntrance = graph.entranceOffsets[clusterIdx];
+            int clusterEntrancesCount = graph.entranceOffsets[clusterIdx + 1] - firstEntrance;
+            const int* row = graph.distances.data() + graph.distanceOffsets[clusterIdx]
+                + (currNodeIdx - firstEntrance) * clusterEntrancesCount;
+
+            for (int i = 0; i < clusterEntrancesCount; i++)
+            {
+                if (row[i] > 0)
+                {
+                    pushClusterNode(map, pathFinder, firstEntrance + i, graph.entranceCells[firstEntrance + i],
+                        currNodeIdx, currNode.cost + row[i], playerIdx, maxCost);
+                }
+            }
+
+            for (int i = graph.crossingOffsets[currNodeIdx]; i < graph.crossingOffsets[currNodeIdx + 1]; i++)
+            {
+                int target = graph.crossingTargets[i];
+                pushClusterNode(map, pathFinder, target, graph.entranceCells[target], currNodeIdx, currNode.cost + 1, playerIdx, maxCost);
+            }
+        }
+
+        if (clusterIdx == playerCluster)
+        {
+            int distance = pathFinder.goalDistances[getClusterLocalIdx(map, currIdx)];
+            if (distance != -1)
+            {
+                pushClusterNode(map, pathFinder, playerNode, playerIdx, currNodeIdx, currNode.cost + distance, playerIdx, maxCost);
+            }
+        }
+    }
+
+    if (!isVisited(pathFinder, playerNode))
+    {
+        return false;
+    }
+
+    waypoints.clear();
+
+    for (int node = playerNode; node != -1; node = pathFinder.parents[node])
+    {
+        if (node == playerNode)
+        {
+            waypoints.push_back(playerIdx);
+        }
+        else if (node == enemyNode)
+        {
+            waypoints.push_back(enemyIdx);
+        }
+        else
+        {
+            waypoints.push_back(graph.entranceCells[node]);
+        }
+    }
+
+    std::reverse(waypoints.begin(), waypoints.end());
+    return true;
+}
+
+// Extends the route from its last cell to the target, a cell of the same cluster with the given flood from it
+void appendClusterDescent(const Map& map, PathFinder& pathFinder, const std::vector<int>& distances, int targetIdx)
+{
+    const ClusterGraph& graph = pathFinder.paths->clusterGraph;
+    EnemyRoute& route = pathFinder.route;
+    int clusterIdx = getCellCluster(map, graph, targetIdx);
+    int currIdx = route.cells.back();
+
+    while (currIdx != targetIdx)
+    {
+        int currDistance = distances[getClusterLocalIdx(map, currIdx)];
+
+        for (size_t i = 0; i < DIRECTIONS_COUNT; i++)
+        {
+            int newIdx = getEnemyNeighbourIdx(map, pathFinder.paths->passability, currIdx, i);
+            if (newIdx != -1 && getCellCluster(map, graph, newIdx) == clusterIdx
+                && distances[getClusterLocalIdx(map, newIdx)] == currDistance - 1)
+            {
+                currIdx = newIdx;
+                break;
+            }
+        }
+
+        route.cells.push_back(currIdx);
+    }
+}
+
+// The route ends at the first waypoint. A waypoint in the same cluster is reached by descending
+// a flood of that cluster, one across a border is a step away.
+void appendClusterRoute(const Map& map, PathFinder& pathFinder)
+{
+    const ClusterGraph& graph = pathFinder.paths->clusterGraph;
+    const std::vector<int>& waypoints = pathFinder.waypoints;
+    EnemyRoute& route = pathFinder.route;
+
+    for (size_t i = 1; i < waypoints.size(); i++)
+    {
+        int currIdx = route.cells.back();
+        int nextIdx = waypoints[i];
+
+        if (currIdx == nextIdx)
+        {
+            continue;
+        }
+
+        if (getCellCluster(map, graph, currIdx) != getCellCluster(map, graph, nextIdx))
+        {
+            route.cells.push_back(nextIdx);
+            continue;
+        }
+
+        floodCluster(map, pathFinder.paths->passability, graph, nextIdx, pathFinder.clusterDistances, pathFinder.clusterFrontier);
+        appendClusterDescent(map, pathFinder, pathFinder.clusterDistances, nextIdx);
+    }
+}
+
+void storeClusterRoute(const Map& map, PathFinder& pathFinder)
+{
+    EnemyRoute& route = pathFinder.route;
+
+    clearEnemyRoute(route);
+    route.isShortest = false;
+    route.cells.push_back(pathFinder.waypoints[0]);
+    appendClusterRoute(map, pathFinder);
+}
+
+int getRouteDetour(const Map& map, const EnemyRoute& route, int enemyIdx, int playerIdx)
+{
+    return (int)(route.cells.size() - route.start - 1) - getManhattanDistance(map, enemyIdx, playerIdx);
+}
+
+// Only the end of the route changes: within the cluster it ends in it is descended again from where
+// it entered the cluster, and when the player has crossed into another cluster it is searched for from
+// that entry, no further than the old end and a step past it. The entry is at most a cluster away from
+// the player, so neither costs more on a larger map.
+bool patchClusterRoute(const Map& map, PathFinder& pathFinder, int enemyIdx, int playerIdx)
+{
+    const ClusterGraph& graph = pathFinder.paths->clusterGraph;
+    EnemyRoute& route = pathFinder.route;
+
+    if (route.start >= route.cells.size() || route.cells[route.start] != enemyIdx)
+    {
+        return false;
+    }
+
+    int goalCluster = getCellCluster(map, graph, route.cells.back());
+    size_t entryIdx = route.cells.size() - 1;
+
+    while (entryIdx > route.start && getCellCluster(map, graph, route.cells[entryIdx - 1]) == goalCluster)
+    {
+        entryIdx--;
+    }
+
+    int entryCellIdx = route.cells[entryIdx];
+
+    if (getCellCluster(map, graph, playerIdx) == goalCluster)
+    {
+        floodCluster(map, pathFinder.paths->passability, graph, playerIdx, pathFinder.goalDistances, pathFinder.clusterFrontier);
+
+        if (pathFinder.goalDistances[getClusterLocalIdx(map, entryCellIdx)] == -1)
+        {
+            return false;
+        }
+
+        route.cells.resize(entryIdx + 1);
+        appendClusterDescent(map, pathFinder, pathFinder.goalDistances, playerIdx);
+    }
+    else
+    {
+        int maxCost = (int)(route.cells.size() - entryIdx) + ROUTE_PATCH_SLACK;
+
+        if (!findClusterPath(map, pathFinder, entryCellIdx, playerIdx, maxCost))
+        {
+            return false;
+        }
+
+        route.cells.resize(entryIdx + 1);
+        appendClusterRoute(map, pathFinder);
+    }
+
+    route.isShortest = false;
+
+    // Patches follow where the player went, once that turns into a detour the route is planned anew
+    return getRouteDetour(map, route, enemyIdx, playerIdx) <= 2 * route.plannedDetour + ROUTE_MAX_EXTRA_DETOUR;
+}
+
+// The route is planned over the whole cluster graph only when the enemy has none to patch, e.g. when
+// the hunt starts or after the player went through a portal
+MapCoordinate followClusterGraph(const Map& map, PathFinder& pathFinder, int enemyIdx, int playerIdx, size_t enemyStepsPerMove)
+{
+    EnemyRoute& route = pathFinder.route;
+
+    // Entrances can be far from where a short path crosses a border, so a close player is searched for directly
+    if (getManhattanDistance(map, enemyIdx, playerIdx) <= LOCAL_SEARCH_MAX_COST
+        && findAStarPath(map, pathFinder, enemyIdx, playerIdx, LOCAL_SEARCH_MAX_COST))
+    {
+        route.misses++;
+        storeParentsRoute(pathFinder, playerIdx);
+        route.plannedDetour = getRouteDetour(map, route, enemyIdx, playerIdx);
+        return followEnemyRoute(map, route, enemyStepsPerMove);
+    }
+
+    if (patchClusterRoute(map, pathFinder, enemyIdx, playerIdx))
+    {
+        route.hits++;
+        return followEnemyRoute(map, route, enemyStepsPerMove);
+    }
+
+    route.misses++;
+
+    if (!findClusterPath(map, pathFinder, enemyIdx, playerIdx))
+    {
+        clearEnemyRoute(route);
+        return map.enemyPosition;
+    }
+
+    storeClusterRoute(map, pathFinder);
+    route.plannedDetour = getRouteDetour(map, route, enemyIdx, playerIdx);
+    return followEnemyRoute(map, route, enemyStepsPerMove);
+}
+
+// The field rooted at the player is reused across moves and repaired with A* while the player stays near the root
+MapCoordinate followDistanceField(const Map& map, PathFinder& pathFinder, int enemyIdx, int playerIdx, size_t enemyStepsPerMove)
+{
+    DistanceField& field = pathFinder.distanceField;
+    size_t cellsCount = getCellsCount(map);
+
+    // Repairs are cheap while the player stays close to the root, once they add up to a full flood it is re-rooted
+    bool isStale = field.rootIdx == -1
+        || field.distances[playerIdx] == -1
+        || field.repairCost > cellsCount;
+
+    if (isStale)
+    {
+        buildDistanceField(map, pathFinder, playerIdx);
+    }
+
+    if (field.rootIdx == playerIdx)
+    {
+        storeFieldRoute(map, pathFinder, enemyIdx);
+    }
+    else if (repairDistanceField(map, pathFinder, enemyIdx, playerIdx))
+    {
+        storeParentsRoute(pathFinder, playerIdx);
+    }
+    else
+    {
+        return map.enemyPosition;
+    }
+
+    return followEnemyRoute(map, pathFinder.route, enemyStepsPerMove);
+}
+
+// The route is kept while it is provably still shortest: the enemy walked part of it and the player
+// stayed at its end, stepped back onto it or stepped off its end where nothing shorter can exist
+bool reuseEnemyRoute(const Map& map, EnemyRoute& route, int enemyIdx, int playerIdx)
+{
+    if (route.start >= route.cells.size() || route.cells[route.start] != enemyIdx)
+    {
+        return false;
+    }
+
+    int targetIdx = route.cells.back();
+    int routeLength = route.cells.size() - route.start - 1;
+
+    if (targetIdx == playerIdx)
+    {
+        return true;
+    }
+
+    if (routeLength > 0 && route.cells[route.cells.size() - 2] == playerIdx)
+    {
+        route.cells.pop_back();
+        return true;
+    }
+
+    // No path to the player is shorter than the Manhattan distance, so one step longer is still shortest
+    if (getManhattanDistance(map, targetIdx, playerIdx) == 1
+        && getManhattanDistance(map, enemyIdx, playerIdx) == routeLength + 1)
+    {
+        route.cells.push_back(playerIdx);
+        return true;
+    }
+
+    return false;
+}
+
+MapCoordinate findShortestPath(const Map& map, PathFinder& pathFinder, size_t enemyStepsPerMove)
+{
+    MapCoordinate enemyNewPosition = {};
+
+    if (map.matrix == nullptr)
+    {
+        return enemyNewPosition;
+    }
+
+    int enemyIdx = getCellIndex(map, map.enemyPosition);
+    int playerIdx = getCellIndex(map, map.playerPosition);
+
+    if (pathFinder.paths == nullptr)
+    {
+        preparePathFinder(map, pathFinder);
+    }
+
+    // The enemy can't reach the player (e.g. after a teleport), so it waits without searching
+    if (pathFinder.paths->components[enemyIdx] != pathFinder.paths->components[playerIdx])
+    {
+        return map.enemyPosition;
+    }
+
+    if (!pathFinder.paths->nextHops.directions.empty())
+    {
+        return followNextHops(map, pathFinder.paths->nextHops, enemyIdx, playerIdx, enemyStepsPerMove);
+    }
+
+    bool isRouteReused = reuseEnemyRoute(map, pathFinder.route, enemyIdx, playerIdx);
+
+    // A cluster route is kept until the player is close enough for the exact local search to find it
+    if (isRouteReused && !pathFinder.route.isShortest
+        && getManhattanDistance(map, enemyIdx, playerIdx) <= LOCAL_SEARCH_MAX_COST
+        && findAStarPath(map, pathFinder, enemyIdx, playerIdx, LOCAL_SEARCH_MAX_COST))
+    {
+        pathFinder.route.misses++;
+        storeParentsRoute(pathFinder, playerIdx);
+        return followEnemyRoute(map, pathFinder.route, enemyStepsPerMove);
+    }
+
+    if (isRouteReused)
+    {
+        pathFinder.route.hits++;
+        return followEnemyRoute(map, pathFinder.route, enemyStepsPerMove);
+    }
+
+    // On the largest maps the level's own search would still cover the whole map every move
+    if (!pathFinder.paths->clusterGraph.entranceOffsets.empty())
+    {
+        return followClusterGraph(map, pathFinder, enemyIdx, playerIdx, enemyStepsPerMove);
+    }
+
+    pathFinder.route.misses++;
+    clearEnemyRoute(pathFinder.route);
+
+    switch (pathFinder.search)
+    {
+    case SEARCH_A_STAR:
+        if (!findAStarPath(map, pathFinder, enemyIdx, playerIdx))
+        {
+            return map.enemyPosition;
+        }
+
+        storeParentsRoute(pathFinder, playerIdx);
+        return followEnemyRoute(map, pathFinder.route, enemyStepsPerMove);
+
+    case SEARCH_JUMP_POINTS:
+        if (!findJumpPointPath(map, pathFinder, enemyIdx, playerIdx))
+        {
+            return map.enemyPosition;
+        }
+
+        storeJumpRoute(map, pathFinder, playerIdx);
+        return followEnemyRoute(map, pathFinder.route, enemyStepsPerMove);
+
+    default:
+        return followDistanceField(map, pathFinder, enemyIdx, playerIdx, enemyStepsPerMove);
+    }
+}
+
+MoveResult move(Game& game, int& lives, char playerMove)
+{
+    MapCoordinate& plCoordinate = game.map.playerPosition;
+    MapCoordinate newPosition = plCoordinate;
+
+    if (game.map.matrix == nullptr)
+    {
+        return INVALID_MOVE;
+    }
+
+    if (!changePosition(newPosition, playerMove))
+    {
+        return INVALID_MOVE;
+    }
+
+    if (!isValidCoordinate(newPosition, game.map.rowsCount, game.map.colsCount))
+    {
+        return INVALID_MOVE;
+    }
+    if (isSamePosition(newPosition, game.map.enemyPosition))
+    {
+        lives = 0;
+        return ENEMY_ENCOUNTER;
+    }
+
+    switch (getTile(game.map, newPosition))
+    {
+    case WALL:
+        lives--;
+        return WALL_HIT;
+
+    case SPACE:
+        plCoordinate = newPosition;
+        return NONE;
+
+    case COIN:
+        game.coinsCollected++;
+        plCoordinate = newPosition;
+        clearTile(game.map, newPosition);
+        return COIN_COLLECTED;
+
+    case KEY:
+        game.keyFound = true;
+        plCoordinate = newPosition;
+        clearTile(game.map, newPosition);
+        return KEY_FOUND;
+
+    case PORTAL:
+        plCoordinate = findNextPortal(game.map, newPosition);
+        return TELEPORTATION;
+
+    case TREASURE:
+        plCoordinate = newPosition;
+
+        if (game.keyFound)
+        {
+            return TREASURE_WITH_KEY;
+        }
+
+        return TREASURE_WITHOUT_KEY;
+
+    default:
+        return INVALID_MOVE;
+    }
+}
+
+bool winCondition(MoveResult moveRes)
+{
+    return moveRes == TREASURE_WITH_KEY;
+}
+
+bool lossCondition(int lives)
+{
+    return lives == 0;
+}
+
+void winUpdate(const Game& game, Player& player)
+{
+    if (game.map.matrix == nullptr)
+    {
+        return;
+    }
+
+    player.coins += game.coinsCollected;
+
+    if ((game.level != MAX_LEVEL)
+        && player.level == game.level)
+    {
+        player.level++;
+    }
+
+    updateLeaderboardEntry(player);
+}
+
+void lossUpdate(Player& player)
+{
+    player.lives = 1;
+    updateLeaderboardEntry(player);
+}
+
+bool savePlayerInfo(std::ofstream& outFile, const Player& player)
+{
+    if (!outFile.is_open())
+    {
+        return false;
+    }
+
+    outFile << player.name << std::endl;
+    outFile << player.level << std::endl;
+    outFile << player.lives << std::endl;
+    outFile << player.coins << std::endl;
+
+    return true;
+}
+
+bool appendMapInfo(std::ofstream& outFile, const Map& map)
+{
+    if (!outFile.is_open())
+    {
+        return false;
+    }
+
+    outFile << map.rowsCount << std::endl;
+    outFile << map.colsCount << std::endl;
+    outFile << map.portalsCount << std::endl;
+
+    for (size_t i = 0; i < map.rowsCount; i++)
+    {
+        for (size_t j = 0; j < map.colsCount; j++)
+        {
+            MapCoordinate currPosition = { i, j };
+
+            if (isSamePosition(currPosition, map.playerPosition))
+            {
+                outFile << PLAYER;
+            }
+            else if (isSamePosition(currPosition, map.enemyPosition))
+            {
+                outFile << ENEMY;
+            }
+            else
+            {
+                outFile << getTile(map, currPosition);
+            }
+        }
+        outFile << std::endl;
+    }
+
+    return true;
+}
+
+bool appendGameInfo(std::ofstream& outFile, const Game& game)
+{
+    if (game.map.matrix == nullptr)
+    {
+        return false;
+    }
+
+    if (!outFile.is_open())
+    {
+        return false;
+    }
+
+    outFile << game.keyFound << std::endl;
+    outFile << game.coinsCollected << std::endl;
+    outFile << game.level << std::endl;
+
+    appendMapInfo(outFile, game.map);
+
+    return true;
+}
+
+void enterUsername(Player& player)
+{
+    std::cout << "Please enter username:" << std::endl;
+    std::cin.getline(player.name, NAME_MAX_LENGTH);
+
+    while (getStrLen(player.name) < NAME_MIN_LENGTH)
+    {
+        std::cout << "Your name must have at least " << NAME_MIN_LENGTH << " symbols. Please, try again!" << std::endl;
+        std::cin.getline(player.name, NAME_MAX_LENGTH);
+    }
+}
+
+bool savePlayerGames(std::ofstream& outFile, const Player& player)
+{
+    if (!outFile.is_open())
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < player.level; i++)
+    {
+        const Game& savedGame = player.savedGamesPerLevel[i];
+
+        if (savedGame.map.matrix == nullptr)
+        {
+            continue;
+        }
+
+        appendGameInfo(outFile, savedGame);
+    }
+
+    return true;
+}
+
+void appendJournalInts(std::vector<char>& journal, const int* values, int valuesCount)
+{
+    const char* bytes = (const char*)values;
+    journal.insert(journal.end(), bytes, bytes + valuesCount * sizeof(int));
+}
+
+void addJournalRecord(Player& player, char type, const int* fields, int fieldsCount)
+{
+    player.pendingJournal.push_back(type);
+    appendJournalInts(player.pendingJournal, fields, fieldsCount);
+}
+
+void journalPlayerStats(Player& player)
+{
+    int fields[] = { player.level, player.lives, player.coins };
+    addJournalRecord(player, JOURNAL_PLAYER_STATS, fields, 3);
+}
+
+void journalGameStarted(Player& player, const Game& game)
+{
+    int fields[] = { game.level, (int)game.mapId };
+    addJournalRecord(player, JOURNAL_GAME_STARTED, fields, 2);
+}
+
+void journalGameResumed(Player& player, int level)
+{
+    addJournalRecord(player, JOURNAL_GAME_RESUMED, &level, 1);
+}
+
+// Only the player's move is replayed, the enemy's position is stored because its path depends on the search state
+void journalMove(Player& player, char playerMove, const Map& map)
+{
+    int enemyIdx = getCellIndex(map, map.enemyPosition);
+
+    player.pendingJournal.push_back(JOURNAL_MOVE);
+    player.pendingJournal.push_back(playerMove);
+    appendJournalInts(player.pendingJournal, &enemyIdx, 1);
+}
+
+void journalGameEnded(Player& player, int level)
+{
+    addJournalRecord(player, JOURNAL_GAME_ENDED, &level, 1);
+}
+
+int getJournalFieldsCount(char type)
+{
+    switch (type)
+    {
+    case JOURNAL_PLAYER_STATS:
+        return 3;
+
+    case JOURNAL_GAME_STARTED:
+        return 2;
+
+    case JOURNAL_CHECKPOINT:
+    case JOURNAL_GAME_RESUMED:
+    case JOURNAL_MOVE:
+    case JOURNAL_GAME_ENDED:
+        return 1;
+
+    default:
+        return -1;
+    }
+}
+
+// activeLevel is the level of the game the following moves belong to, 0 if there is none
+// The game can't be rebuilt, e.g. its map was edited and has a new fingerprint. Only that game is
+// lost, its remaining moves are skipped and the other levels are still replayed.
+void dropJournalGame(Player& player, int level, int& activeLevel, int& droppedLevels)
+{
+    deleteMap(player.savedGamesPerLevel[level - 1].map);
+    droppedLevels |= 1 << (level - 1);
+
+    if (activeLevel == level)
+    {
+        activeLevel = 0;
+    }
+}
+
+void applyJournalRecord(Player& player, const MapCatalog& catalog, char type, char playerMove, const int* fields,
+    int& activeLevel, int& droppedLevels)
+{
+    if (type == JOURNAL_PLAYER_STATS)
+    {
+        player.level = fields[0];
+        player.lives = fields[1];
+        player.coins = fields[2];
+        return;
+    }
+
+    if (type == JOURNAL_MOVE)
+    {
+        if (activeLevel == 0)
+        {
+            return;
+        }
+
+        Game& game = player.savedGamesPerLevel[activeLevel - 1];
+        move(game, player.lives, playerMove);
+
+        MapCoordinate enemyPosition = getCellCoordinate(game.map, fields[0]);
+        if (!isValidCoordinate(enemyPosition, game.map.rowsCount, game.map.colsCount))
+        {
+            dropJournalGame(player, activeLevel, activeLevel, droppedLevels);
+            return;
+        }
+
+        game.map.enemyPosition = enemyPosition;
+        return;
+    }
+
+    int level = fields[0];
+    if (!isInRange(level, MIN_LEVEL, MAX_LEVEL))
+    {
+        // The moves that follow can't be told apart from the active game's, so they are skipped
+        activeLevel = 0;
+        return;
+    }
+
+    Game& savedGame = player.savedGamesPerLevel[level - 1];
+
+    switch (type)
+    {
+    case JOURNAL_GAME_STARTED:
+    {
+        const Game* gameTemplate = findMapTemplate(catalog, level, fields[1]);
+        if (gameTemplate == nullptr)
+        {
+            activeLevel = level;
+            dropJournalGame(player, level, activeLevel, droppedLevels);
+            return;
+        }
+
+        savedGame = startGameFromTemplate(*gameTemplate);
+        activeLevel = level;
+        return;
+    }
+
+    case JOURNAL_GAME_RESUMED:
+        activeLevel = savedGame.map.matrix != nullptr ? level : 0;
+        return;
+
+    case JOURNAL_GAME_ENDED:
+        deleteMap(savedGame.map);
+        activeLevel = 0;
+        return;
+
+    default:
+        return;
+    }
+}
+
+// Replays the records written after the last checkpoint. Returns false if a record is torn or
+// can't be applied, the records before it stay applied. A journal left over from an older
+// checkpoint, by a crash while compacting, is not applied and also returns false.
+// Only a torn record or a journal that doesn't follow the checkpoint ends the replay. Levels whose
+// game had to be dropped are set in droppedLevels, one bit per level.
+bool readPlayerJournal(Player& player, const MapCatalog& catalog, int* droppedLevels = nullptr)
+{
+    char* checkpointFilePath = getPlayerFilePath(player.name);
+    unsigned int checkpointChecksum = getFileChecksum(checkpointFilePath);
+    delete[] checkpointFilePath;
+
+    char* filePath = getPlayerJournalFilePath(player.name);
+    std::ifstream inFile(filePath, std::ios::binary | std::ios::ate);
+    delete[] filePath;
+
+    player.journalSize = 0;
+
+    if (!inFile.is_open())
+    {
+        return true;
+    }
+
+    std::vector<char> journal((size_t)inFile.tellg());
+    inFile.seekg(0);
+    inFile.read(journal.data(), journal.size());
+    inFile.close();
+
+    player.journalSize = journal.size();
+
+    const size_t checkpointRecordSize = 1 + sizeof(int);
+    if (journal.size() < checkpointRecordSize || journal[0] != JOURNAL_CHECKPOINT
+        || memcmp(journal.data() + 1, &checkpointChecksum, sizeof(int)) != 0)
+    {
+        return false;
+    }
+
+    size_t position = checkpointRecordSize;
+    int activeLevel = 0;
+    int journalDroppedLevels = 0;
+
+    while (position < journal.size())
+    {
+        char type = journal[position++];
+        int fieldsCount = getJournalFieldsCount(type);
+        size_t moveSize = type == JOURNAL_MOVE ? 1 : 0;
+
+        if (fieldsCount == -1 || position + moveSize + fieldsCount * sizeof(int) > journal.size())
+        {
+            return false;
+        }
+
+        char playerMove = moveSize > 0 ? journal[position] : 0;
+        int fields[3];
+        memcpy(fields, journal.data() + position + moveSize, fieldsCount * sizeof(int));
+        position += moveSize + fieldsCount * sizeof(int);
+
+        applyJournalRecord(player, catalog, type, playerMove, fields, activeLevel, journalDroppedLevels);
+    }
+
+    if (droppedLevels != nullptr)
+    {
+        *droppedLevels = journalDroppedLevels;
+    }
+
+    return true;
+}
+
+// Writes the player file to a temp file and commits it, returns the checksum of the new file or 0
+unsigned int commitPlayerFile(const Player& player)
+{
+    char* filePath = getPlayerFilePath(player.name);
+    char* tempFilePath = getTempFilePath(filePath);
+
+    std::ofstream outFile(tempFilePath);
+    savePlayerInfo(outFile, player);
+    savePlayerGames(outFile, player);
+    outFile.close();
+
+    unsigned int checksum = 0;
+
+    if (!outFile.fail())
+    {
+        checksum = getFileChecksum(tempFilePath);
+    }
+
+    if (checksum != 0 && !commitTempFile(tempFilePath, filePath))
+    {
+        checksum = 0;
+    }
+
+    delete[] tempFilePath;
+    delete[] filePath;
+
+    return checksum;
+}
+
+// Rewrites the whole player file and starts a new journal, the old one's records are all in the new file.
+// Both files are replaced atomically. If the journal isn't replaced, its old checkpoint record no longer
+// matches the player file, so its records aren't applied twice.
+bool writePlayerCheckpoint(Player& player)
+{
+    unsigned int checksum = commitPlayerFile(player);
+
+    if (checksum == 0)
+    {
+        return false;
+    }
+
+    char* journalFilePath = getPlayerJournalFilePath(player.name);
+    char* tempFilePath = getTempFilePath(journalFilePath);
+
+    std::vector<char> journal;
+    journal.push_back(JOURNAL_CHECKPOINT);
+    appendJournalInts(journal, (const int*)&checksum, 1);
+
+    std::ofstream outFile(tempFilePath, std::ios::binary);
+    outFile.write(journal.data(), journal.size());
+    outFile.close();
+
+    bool isCommitted = !outFile.fail() && commitTempFile(tempFilePath, journalFilePath);
+
+    delete[] tempFilePath;
+    delete[] journalFilePath;
+
+    player.journalSize = isCommitted ? journal.size() : 0;
+
+    return isCommitted;
+}
+
+// All records since the last save are written and flushed together, so a save costs one flush
+// however many moves it holds. A torn append is detected and compacted on the next log in.
+bool appendPlayerJournal(Player& player)
+{
+    char* filePath = getPlayerJournalFilePath(player.name);
+    std::ofstream outFile(filePath, std::ios::binary | std::ios::app);
+
+    if (!outFile.is_open())
+    {
+        delete[] filePath;
+        return false;
+    }
+
+    outFile.write(player.pendingJournal.data(), player.pendingJournal.size());
+    outFile.close();
+
+    bool isFlushed = !outFile.fail() && flushFileToDisk(filePath);
+    delete[] filePath;
+
+    if (!isFlushed)
+    {
+        return false;
+    }
+
+    player.journalSize += player.pendingJournal.size();
+
+    return true;
+}
+
+// Appends what changed since the last save to the journal. Once the journal outgrows
+// JOURNAL_COMPACT_SIZE it is compacted into a new checkpoint of the player file. A player
+// without a journal, such as a new one, gets a checkpoint first.
+bool savePlayerProgress(Player& player)
+{
+    if (player.name == nullptr)
+    {
+        return false;
+    }
+
+    journalPlayerStats(player);
+
+    char* filePath = getPlayerFilePath(player.name);
+    bool hasCheckpoint = fileExists(filePath);
+    delete[] filePath;
+
+    bool isSaved;
+
+    if (!hasCheckpoint || player.journalSize == 0
+        || player.journalSize + player.pendingJournal.size() > JOURNAL_COMPACT_SIZE)
+    {
+        isSaved = writePlayerCheckpoint(player);
+    }
+    else
+    {
+        isSaved = appendPlayerJournal(player);
+    }
+
+    if (isSaved)
+    {
+        player.pendingJournal.clear();
+    }
+
+    // The journal is written first, a crash before the record is updated is repaired on the next log in
+    bool isRecordUpdated = updateLeaderboardEntry(player);
+
+    return isSaved && isRecordUpdated;
+}
+
+// The player's results and saved games come from the player file and its journal, the store only
+// has the results of a player whose file was never written
+bool getPlayerByName(const char* name, Player& player, const PlayerIndex& playerIndex, const MapCatalog& catalog)
+{
+    if (name == nullptr)
+    {
+        return false;
+    }
+
+    int slot = findIndexedPlayer(playerIndex, name);
+    LeaderboardEntry entry;
+
+    if (slot == -1 || !readPlayerRecord(slot, entry))
+    {
+        return false;
+    }
+
+    char* filePath = getPlayerFilePath(name);
+    std::ifstream inFile(filePath);
+    delete[] filePath;
+
+    bool hasPlayerFile = inFile.is_open();
+
+    if (hasPlayerFile)
+    {
+        readPlayerInfo(inFile, player);
+        inFile.ignore();
+        readSavedGames(inFile, player);
+
+        inFile.close();
+    }
+
+    bool isJournalRead = readPlayerJournal(player, catalog);
+
+    strCopy(entry.name, player.name, 0);
+    player.leaderboardSlot = slot;
+
+    if (!hasPlayerFile)
+    {
+        player.level = entry.level;
+        player.lives = entry.lives;
+        player.coins = entry.coins;
+    }
+    // The record is written after the journal without its protection, so one that doesn't match is rebuilt
+    else if (entry.level != player.level || entry.lives != player.lives || entry.coins != player.coins)
+    {
+        updateLeaderboardEntry(player);
+    }
+
+    // A torn or unusable journal is folded into a fresh checkpoint right away, so later records aren't appended after it
+    if (!isJournalRead)
+    {
+        writePlayerCheckpoint(player);
+    }
+
+    return true;
+}
+
+int getGameLevel(const Player& player)
+{
+    int maxLevel = player.level;
+
+    if (maxLevel == MIN_LEVEL)
+    {
+        return maxLevel;
+    }
+
+    std::cout << "Please enter the level you want to play. It must be between " << MIN_LEVEL << " and " << maxLevel << std::endl;
+    return getNumberInRange(MIN_LEVEL, maxLevel);
+}
+
+int enemyMovesPerPlayerMove(const Game& game)
+{
+    if (game.level == MAX_LEVEL)
+    {
+        return 2;
+    }
+
+    return 1;
+}
+
+// The search used when the level's maps are too large for a next hop table. Bigger levels are
+// more open, where A* and jump points expand far fewer cells than flooding a distance field.
+PathSearch getLevelPathSearch(int level)
+{
+    if (level == MAX_LEVEL)
+    {
+        return SEARCH_JUMP_POINTS;
+    }
+
+    if (level == MIN_LEVEL)
+    {
+        return SEARCH_DISTANCE_FIELD;
+    }
+
+    return SEARCH_A_STAR;
+}
+
+void initGameEngine(GameEngine& engine, Game& game, int lives)
+{
+    engine.game = &game;
+    engine.lives = lives;
+    engine.enemyStepsPerMove = enemyMovesPerPlayerMove(game);
+    engine.outcome = GAME_IN_PROGRESS;
+    engine.pathFinder.search = getLevelPathSearch(game.level);
+
+    if (game.map.matrix != nullptr)
+    {
+        preparePathFinder(game.map, engine.pathFinder);
+    }
+}
+
+// Plays one player move and the enemy's answer to it without any console I/O
+MoveResult playMove(GameEngine& engine, char playerMove)
+{
+    if (engine.game == nullptr || engine.outcome != GAME_IN_PROGRESS)
+    {
+        return INVALID_MOVE;
+    }
+
+    Map& map = engine.game->map;
+    MoveResult moveRes = move(*engine.game, engine.lives, playerMove);
+
+    if (winCondition(moveRes))
+    {
+        engine.outcome = GAME_WON;
+        return moveRes;
+    }
+    if (lossCondition(engine.lives))
+    {
+        engine.outcome = GAME_LOST;
+        return moveRes;
+    }
+    if (moveRes == INVALID_MOVE)
+    {
+        return moveRes;
+    }
+
+    map.enemyPosition = findShortestPath(map, engine.pathFinder, engine.enemyStepsPerMove);
+
+    if (isSamePosition(map.playerPosition, map.enemyPosition))
+    {
+        engine.outcome = GAME_LOST;
+        return ENEMY_ENCOUNTER;
+    }
+
+    return moveRes;
+}
+
+GameOutcome playMoves(GameEngine& engine, const char* moves, size_t movesCount, std::vector<MoveRecord>& records)
+{
+    if (moves == nullptr)
+    {
+        return engine.outcome;
+    }
+
+    for (size_t i = 0; i < movesCount && engine.outcome == GAME_IN_PROGRESS; i++)
+    {
+        MoveResult moveRes = playMove(engine, moves[i]);
+        const Map& map = engine.game->map;
+
+        records.push_back({ moveRes, map.playerPosition, map.enemyPosition });
+    }
+
+    return engine.outcome;
+}
+
+Game setUpGame(Player& player, const MapCatalog& catalog)
+{
+    int level = getGameLevel(player);
+    Game& savedGame = player.savedGamesPerLevel[level - 1];
+
+    if (savedGame.map.matrix != nullptr)
+    {
+        bool continuePrevGame = inputYesNo("Would you like to continue from where you left off?");
+
+        if (continuePrevGame)
+        {
+            journalGameResumed(player, level);
+            return std::move(savedGame);
+        }
+
+        deleteMap(savedGame.map);
+    }
+
+    const std::vector<Game>& levelMaps = catalog.levelMaps[level - 1];
+
+    if (levelMaps.empty())
+    {
+        Game game = {};
+        game.level = level;
+        return game;
+    }
+
+    int mapIdx = getRandomNumber(0, levelMaps.size() - 1);
+    Game game = startGameFromTemplate(levelMaps[mapIdx]);
+    journalGameStarted(player, game);
+
+    return game;
+}
+
+void printMoveResult(MoveResult moveRes)
+{
+    const char* message = getMoveResultMessage(moveRes);
+
+    if (message != nullptr)
+    {
+        std::cout << message << std::endl;
+    }
+}
+
+void lossUpdateAndPrint(Player& player, MoveResult moveRes)
+{
+    lossUpdate(player);
+    printMoveResult(moveRes);
+    std::cout << "You lose! Better luck next game!" << std::endl;
+}
+
+// Only maps without a next hop table plan routes, on the others there is nothing to report
+void printEnemyRouteStats(const EnemyRoute& route)
+{
+    if (route.hits + route.misses == 0)
+    {
+        return;
+    }
+
+    std::cout << "Enemy routes planned: " << route.misses << ", moves along a planned route: ";
+    std::cout << route.hits << std::endl;
+}
+
+void playGame(Game& game, Player& player)
+{
+    if (game.map.matrix == nullptr)
+    {
+        return;
+    }
+
+    clearConsole();
+    char playerMove;
+    MoveResult moveRes = NONE;
+
+    GameEngine engine;
+    initGameEngine(engine, game, player.lives);
+
+    FrameRenderer renderer;
+    bool isMinimapShown = false;
+
+    while (true)
+    {
+        composeGameFrame(renderer.nextFrame, game, player.lives, moveRes, isMinimapShown);
+        renderFrame(renderer);
+
+        std::cin >> playerMove;
+
+        if (toLower(playerMove) == MINIMAP)
+        {
+            isMinimapShown = !isMinimapShown;
+            moveRes = NONE;
+            continue;
+        }
+
+        if (toLower(playerMove) == QUIT)
+        {
+            clearConsole();
+            player.savedGamesPerLevel[game.level - 1] = std::move(game);
+            savePlayerProgress(player);
+            return;
+        }
+
+        moveRes = playMove(engine, playerMove);
+        player.lives = engine.lives;
+
+        if (moveRes != INVALID_MOVE)
+        {
+            journalMove(player, playerMove, game.map);
+        }
+
+        if (engine.outcome != GAME_IN_PROGRESS)
+        {
+            clearConsole();
+        }
+
+        if (engine.outcome == GAME_WON)
+        {
+            winUpdate(game, player);
+            printMoveResult(moveRes);
+            break;
+        }
+        if (engine.outcome == GAME_LOST)
+        {
+            lossUpdateAndPrint(player, moveRes);
+            break;
+        }
+    }
+
+    printEnemyRouteStats(engine.pathFinder.route);
+    deleteMap(game.map);
+
+    journalGameEnded(player, game.level);
+    savePlayerProgress(player);
+}
+
+void logIn(Player& player, const PlayerIndex& playerIndex, const MapCatalog& catalog)
+{
+    while (!getPlayerByName(player.name, player, playerIndex, catalog))
+    {
+        std::cout << "Name does not exist!" << std::endl;
+        enterUsername(player);
+    }
+}
+
+bool signUp(Player& player, PlayerIndex& playerIndex)
+{
+    while (findIndexedPlayer(playerIndex, player.name) != -1)
+    {
+        std::cout << "Name already exists!" << std::endl;
+        enterUsername(player);
+    }
+
+    // The store record commits the account, a crash before the player file is written
+    // leaves a player without saved games
+    LeaderboardEntry entry;
+    fillLeaderboardEntry(player, entry);
+    player.leaderboardSlot = insertPlayerRecord(entry);
+
+    // Without a record the account could never be logged into, so it isn't created at all
+    if (player.leaderboardSlot == -1)
+    {
+        std::cout << "The account could not be created. Please, try again!" << std::endl;
+        return false;
+    }
+
+    addIndexedPlayer(playerIndex, player.name, player.leaderboardSlot);
+    savePlayerProgress(player);
+
+    return true;
+}
+
+void pressKeyToContinue()
+{
+    std::cout << "Press any key to return to menu" << std::endl;
+
+    std::cin.get();
+    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+
+    clearConsole();
+}
+
+void showLeaderboard(Leaderboard& leaderboard, Player& player)
+{
+    clearConsole();
+    syncLeaderboardEntry(leaderboard, player);
+
+    const int returnToMenu = 0;
+
+    int playersCount = getRanksCount(leaderboard, leaderboard.root);
+    int pagesCount = (playersCount + LEADERBOARD_PAGE_SIZE - 1) / LEADERBOARD_PAGE_SIZE;
+    size_t playerRank = getLeaderboardRank(leaderboard, player.leaderboardSlot);
+    int page = 1;
+
+    while (true)
+    {
+        printLeaderboardPage(leaderboard, page);
+        std::cout << "You are number " << playerRank << " in the leaderboard" << std::endl;
+
+        if (pagesCount <= 1)
+        {
+            pressKeyToContinue();
+            return;
+        }
+
+        std::cout << "Page " << page << " of " << pagesCount << ". Enter a page number or " << returnToMenu << " to return to menu:" << std::endl;
+
+        page = getNumberInRange(returnToMenu, pagesCount);
+        clearConsole();
+
+        if (page == returnToMenu)
+        {
+            return;
+        }
+    }
+}
+
+void buyLives(Player& player)
+{
+    clearConsole();
+
+    const int returnToMenu = 0;
+    const int maxLivesToBuy = 100;
+
+    int initialLives = player.lives;
+    int inputNum;
+
+    while (true)
+    {
+        std::cout << "One life costs " << LIFE_PRICE << " coins" << std::endl;
+        std::cout << "You have " << player.coins << " coins." << std::endl;
+        std::cout << "Enter the number of lives you want to buy or " << returnToMenu << " to return to menu:" << std::endl;
+
+        inputNum = getNumberInRange(returnToMenu, maxLivesToBuy);
+        clearConsole();
+
+        if (inputNum == returnToMenu)
+        {
+            break;
+        }
+
+        int cost = inputNum * LIFE_PRICE;
+
+        if (player.coins < cost)
+        {
+            std::cout << "Not enough coins! You need " << cost << " coins to buy " << inputNum << " lives!" << std::endl;
+            continue;
+        }
+
+        std::cout << "You are about to buy " << inputNum << " lives for " << cost << " coins" << std::endl;
+        bool acceptToBuy = inputYesNo("Are you sure you want to make this purchase?");
+        clearConsole();
+
+        if (acceptToBuy)
+        {
+            player.lives += inputNum;
+            player.coins -= cost;
+            updateLeaderboardEntry(player);
+            break;
+        }
+    }
+
+    if (player.lives > initialLives)
+    {
+        std::cout << "You successfully bought " << player.lives - initialLives << " lives" << std::endl;
+    }
+}
+
+void displayPlayerInfo(const Player& player)
+{
+    clearConsole();
+
+    std::cout << "Name: " << player.name << std::endl;
+    std::cout << "Level: " << player.level << std::endl;
+    std::cout << "Lives: " << player.lives << std::endl;
+    std::cout << "Coins: " << player.coins << std::endl;
+}
+
+void exit(Player& player)
+{
+    savePlayerProgress(player);
+}
+
+int displayMenuOptions()
+{
+    int optionsCount = 0;
+
+    std::cout << "Please enter one of the numbers below to choose an option:" << std::endl;
+    std::cout << ++optionsCount << ") " << "Play a game" << std::endl;
+    std::cout << ++optionsCount << ") " << "Buy lives" << std::endl;
+    std::cout << ++optionsCount << ") " << "View info" << std::endl;
+    std::cout << ++optionsCount << ") " << "View leaderboard" << std::endl;
+    std::cout << ++optionsCount << ") " << "Sign out" << std::endl;
+    std::cout << ++optionsCount << ") " << "Exit" << std::endl;
+
+    return optionsCount;
+}
+
+Player enterApp(PlayerIndex& playerIndex, const MapCatalog& catalog)
+{
+    Player player = {};
+
+    while (true)
+    {
+        int optionNum = getInputOption();
+
+        std::cin.ignore();
+        enterUsername(player);
+
+        if (optionNum == 1)
+        {
+            logIn(player, playerIndex, catalog);
+            break;
+        }
+
+        if (signUp(player, playerIndex))
+        {
+            break;
+        }
+    }
+
+    clearConsole();
+    std::cout << "Welcome " << player.name << std::endl;
+
+    return player;
+}
+
+void signOut(Player& player, PlayerIndex& playerIndex, const MapCatalog& catalog)
+{
+    exit(player);
+    clearConsole();
+    std::cout << "You successfully signed out." << std::endl;
+    player = enterApp(playerIndex, catalog);
+}
+
+bool selectMenuOption(Player& player, Leaderboard& leaderboard, PlayerIndex& playerIndex, const MapCatalog& catalog)
+{
+    int optionsCount = displayMenuOptions();
+    int selectedOption = getNumberInRange(1, optionsCount);
+
+    switch (selectedOption)
+    {
+    case 1:
+    {
+        Game game = setUpGame(player, catalog);
+        playGame(game, player);
+    }
+    break;
+
+    case 2:
+        buyLives(player);
+        break;
+
+    case 3:
+        displayPlayerInfo(player);
+        pressKeyToContinue();
+        break;
+
+    case 4:
+        showLeaderboard(leaderboard, player);
+        break;
+
+    case 5:
+        syncLeaderboardEntry(leaderboard, player);
+        signOut(player, playerIndex, catalog);
+        break;
+
+    case 6:
+        exit(player);
+        return false;
+    }
+
+    return true;
+}
+
+bool isHiddenByCharacters(const Map& map, const MapCoordinate& position)
+{
+    return isSamePosition(position, map.playerPosition)
+        || isSamePosition(position, map.enemyPosition);
+}
+
+// Checks whether a saved game was started on the given map and, if so, whether its coins and key
+// agree with the tiles that are gone. Tiles under the enemy are unknown, since saving overwrites them.
+bool compareWithLevelMap(const Game& savedGame, const Game& levelMap, int& issues)
+{
+    const Map& map = savedGame.map;
+    const Map& originalMap = levelMap.map;
+
+    if (map.rowsCount != originalMap.rowsCount || map.colsCount != originalMap.colsCount)
+    {
+        return false;
+    }
+
+    int remainingCoins = 0;
+    int hiddenCoins = 0;
+    bool hasKey = false;
+    bool keyRemaining = false;
+    bool keyHidden = false;
+
+    for (size_t i = 0; i < map.rowsCount; i++)
+    {
+        for (size_t j = 0; j < map.colsCount; j++)
+        {
+            MapCoordinate position = { i, j };
+            char savedTile = getTile(map, position);
+            char originalTile = getTile(originalMap, position);
+
+            hasKey = hasKey || originalTile == KEY;
+
+            if (isSamePosition(position, map.enemyPosition))
+            {
+                hiddenCoins += originalTile == COIN;
+                keyHidden = originalTile == KEY;
+                continue;
+            }
+            if (isSamePosition(position, map.playerPosition))
+            {
+                continue;
+            }
+
+            if (savedTile == originalTile)
+            {
+                remainingCoins += savedTile == COIN;
+                keyRemaining = keyRemaining || savedTile == KEY;
+                continue;
+            }
+
+            bool isCollected = savedTile == SPACE
+                && (originalTile == COIN || originalTile == KEY);
+
+            if (!isCollected)
+            {
+                return false;
+            }
+        }
+    }
+
+    int maxCollected = levelMap.totalCoins - remainingCoins;
+    int minCollected = maxCollected - hiddenCoins;
+
+    if (!isInRange(savedGame.coinsCollected, minCollected, maxCollected))
+    {
+        issues |= COINS_MISMATCH;
+    }
+
+    bool keyGone = hasKey && !keyRemaining;
+    if (!keyHidden && savedGame.keyFound != keyGone)
+    {
+        issues |= KEY_MISMATCH;
+    }
+
+    return true;
+}
+
+// Plain breadth-first search over the tiles, the reference the enemy's searches are checked against
+int getBfsDistance(const Map& map, int sourceIdx, int targetIdx)
+{
+    std::vector<int> distances(getCellsCount(map), -1);
+    std::vector<int> frontier;
+    size_t frontierHead = 0;
+
+    distances[sourceIdx] = 0;
+    frontier.push_back(sourceIdx);
+
+    while (frontierHead < frontier.size())
+    {
+        int currIdx = frontier[frontierHead];
+        frontierHead++;
+
+        if (currIdx == targetIdx)
+        {
+            return distances[currIdx];
+        }
+
+        for (size_t i = 0; i < DIRECTIONS_COUNT; i++)
+        {
+            int newIdx = currIdx + DIRECTIONS[i][0] * map.stride + DIRECTIONS[i][1];
+
+            if (map.matrix[newIdx] != WALL && distances[newIdx] == -1)
+            {
+                distances[newIdx] = distances[currIdx] + 1;
+                frontier.push_back(newIdx);
+            }
+        }
+    }
+
+    return -1;
+}
+
+int getRouteLength(const EnemyRoute& route)
+{
+    return (int)route.cells.size() - 1;
+}
+
+// A*, jump points and the distance field must all chase the player along a path as short as the one BFS finds
+bool areEnemySearchesShortest(const Map& map)
+{
+    PathFinder pathFinder;
+    buildPassabilityBitmap(map, pathFinder.ownPaths.passability);
+    pathFinder.paths = &pathFinder.ownPaths;
+
+    int enemyIdx = getCellIndex(map, map.enemyPosition);
+    int playerIdx = getCellIndex(map, map.playerPosition);
+    int distance = getBfsDistance(map, enemyIdx, playerIdx);
+
+    bool isFound = findAStarPath(map, pathFinder, enemyIdx, playerIdx);
+    if (isFound != (distance != -1))
+    {
+        return false;
+    }
+
+    if (!isFound)
+    {
+        return true;
+    }
+
+    storeParentsRoute(pathFinder, playerIdx);
+    if (getRouteLength(pathFinder.route) != distance)
+    {
+        return false;
+    }
+
+    if (!findJumpPointPath(map, pathFinder, enemyIdx, playerIdx))
+    {
+        return false;
+    }
+
+    storeJumpRoute(map, pathFinder, playerIdx);
+    if (getRouteLength(pathFinder.route) != distance)
+    {
+        return false;
+    }
+
+    buildDistanceField(map, pathFinder, playerIdx);
+    if (pathFinder.distanceField.distances[enemyIdx] != distance)
+    {
+        return false;
+    }
+
+    storeFieldRoute(map, pathFinder, enemyIdx);
+    return getRouteLength(pathFinder.route) == distance;
+}
+
+int validateSavedGame(const Game& savedGame, const Player& player, const ValidationBatch& batch)
+{
+    int issues = NO_ISSUES;
+    const Map& map = savedGame.map;
+
+    if (savedGame.level > player.level)
+    {
+        issues |= LEVEL_NOT_UNLOCKED;
+    }
+
+    bool arePositionsValid = isValidCoordinate(map.playerPosition, map.rowsCount, map.colsCount)
+        && isValidCoordinate(map.enemyPosition, map.rowsCount, map.colsCount)
+        && !isSamePosition(map.playerPosition, map.enemyPosition)
+        && getTile(map, map.playerPosition) != WALL
+        && getTile(map, map.enemyPosition) != WALL;
+
+    if (!arePositionsValid)
+    {
+        return issues | INVALID_POSITIONS;
+    }
+
+    if (!areEnemySearchesShortest(map))
+    {
+        issues |= ENEMY_PATH_NOT_SHORTEST;
+    }
+
+    const std::vector<Game>& levelMaps = batch.catalog.levelMaps[savedGame.level - 1];
+
+    for (size_t i = 0; i < levelMaps.size(); i++)
+    {
+        if (compareWithLevelMap(savedGame, levelMaps[i], issues))
+        {
+            return issues;
+        }
+    }
+
+    return issues | UNKNOWN_MAP;
+}
+
+void validatePlayerFile(ValidationBatch& batch, size_t fileIdx)
+{
+    PlayerValidation& result = batch.results[fileIdx];
+
+    const char playerDirPath[] = "../Players";
+    const int foldersCount = 2;
+    const char* folders[foldersCount] = { playerDirPath, result.fileName };
+    char* filePath = getFilePath(folders, foldersCount, "");
+
+    std::ifstream inFile(filePath);
+    delete[] filePath;
+
+    Player player = {};
+
+    if (!readPlayerInfo(inFile, player))
+    {
+        result.playerIssues |= UNREADABLE_FILE;
+        return;
+    }
+
+    inFile.ignore();
+
+    if (!readSavedGames(inFile, player))
+    {
+        result.playerIssues |= CORRUPT_SAVED_GAME;
+    }
+
+    inFile.close();
+
+    int droppedLevels = 0;
+
+    if (!readPlayerJournal(player, batch.catalog, &droppedLevels))
+    {
+        result.playerIssues |= CORRUPT_JOURNAL;
+    }
+
+    // A journaled game whose map is gone from the catalog is dropped while replaying
+    for (size_t i = 0; i < MAX_LEVEL; i++)
+    {
+        if (droppedLevels & (1 << i))
+        {
+            result.gameIssues[i] |= UNKNOWN_MAP;
+        }
+    }
+
+    bool areStatsValid = isInRange(player.level, MIN_LEVEL, MAX_LEVEL)
+        && player.lives > 0
+        && player.coins >= 0
+        && getStrLen(player.name) >= NAME_MIN_LENGTH;
+
+    if (!areStatsValid)
+    {
+        result.playerIssues |= INVALID_PLAYER_STATS;
+    }
+
+    for (size_t i = 0; i < MAX_LEVEL; i++)
+    {
+        const Game& savedGame = player.savedGamesPerLevel[i];
+
+        if (savedGame.map.matrix != nullptr)
+        {
+            result.gameIssues[i] |= validateSavedGame(savedGame, player, batch);
+        }
+    }
+}
+
+bool popJob(WorkQueue& queue, size_t& job, bool fromBack)
+{
+    std::lock_guard<std::mutex> lock(queue.mutex);
+
+    if (queue.jobs.empty())
+    {
+        return false;
+    }
+
+    if (fromBack)
+    {
+        job = queue.jobs.back();
+        queue.jobs.pop_back();
+    }
+    else
+    {
+        job = queue.jobs.front();
+        queue.jobs.pop_front();
+    }
+
+    return true;
+}
+
+// Each worker drains its own queue from the back and, once it runs dry,
+// steals from the front of the other workers' queues
+void runValidationWorker(ValidationBatch* batch, size_t workerIdx)
+{
+    size_t job;
+
+    while (true)
+    {
+        bool hasJob = popJob(batch->queues[workerIdx], job, true);
+
+        for (size_t i = 1; i < batch->workersCount && !hasJob; i++)
+        {
+            size_t victimIdx = (workerIdx + i) % batch->workersCount;
+            hasJob = popJob(batch->queues[victimIdx], job, false);
+        }
+
+        if (!hasJob)
+        {
+            return;
+        }
+
+        validatePlayerFile(*batch, job);
+    }
+}
+
+void listPlayerFiles(std::vector<PlayerValidation>& results)
+{
+    const char playerFilesPattern[] = "../Players/*";
+    const int foldersCount = 1;
+    const char* folders[foldersCount] = { playerFilesPattern };
+    char* patternPath = getFilePath(folders, foldersCount);
+
+    WIN32_FIND_DATAA fileData;
+    HANDLE findHandle = FindFirstFileA(patternPath, &fileData);
+    delete[] patternPath;
+
+    if (findHandle == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+
+    do
+    {
+        if (fileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+        {
+            continue;
+        }
+
+        PlayerValidation result = {};
+        strCopy(fileData.cFileName, result.fileName, 0);
+        results.push_back(result);
+    } while (FindNextFileA(findHandle, &fileData));
+
+    FindClose(findHandle);
+}
+
+const char* getValidationIssueMessage(int issue)
+{
+    switch (issue)
+    {
+    case UNREADABLE_FILE:
+        return "the file can't be read";
+
+    case INVALID_PLAYER_STATS:
+        return "invalid name, level, lives or coins";
+
+    case CORRUPT_SAVED_GAME:
+        return "a saved game can't be parsed";
+
+    case LEVEL_NOT_UNLOCKED:
+        return "the level is not unlocked yet";
+
+    case UNKNOWN_MAP:
+        return "the map does not match any map of the level";
+
+    case INVALID_POSITIONS:
+        return "the player or the enemy stands on an invalid tile";
+
+    case COINS_MISMATCH:
+        return "the collected coins don't match the map";
+
+    case KEY_MISMATCH:
+        return "the key state doesn't match the map";
+
+    case CORRUPT_JOURNAL:
+        return "the move journal can't be replayed";
+
+    case ENEMY_PATH_NOT_SHORTEST:
+        return "an enemy search misses the shortest path to the player";
+
+    default:
+        return "unknown issue";
+    }
+}
+
+void printValidationIssues(const char* fileName, int level, int issues)
+{
+    for (size_t i = 0; i < VALIDATION_ISSUES_COUNT; i++)
+    {
+        int issue = 1 << i;
+
+        if (!(issues & issue))
+        {
+            continue;
+        }
+
+        std::cout << fileName << ": ";
+
+        if (level > 0)
+        {
+            std::cout << "level " << level << ": ";
+        }
+
+        std::cout << getValidationIssueMessage(issue) << std::endl;
+    }
+}
+
+void validateAllPlayers()
+{
+    ValidationBatch batch;
+
+    loadMapCatalog(batch.catalog);
+
+    listPlayerFiles(batch.results);
+
+    batch.workersCount = std::max(std::thread::hardware_concurrency(), 1u);
+    batch.queues = new WorkQueue[batch.workersCount];
+
+    for (size_t i = 0; i < batch.results.size(); i++)
+    {
+        batch.queues[i % batch.workersCount].jobs.push_back(i);
+    }
+
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < batch.workersCount; i++)
+    {
+        workers.push_back(std::thread(runValidationWorker, &batch, i));
+    }
+
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
+
+    delete[] batch.queues;
+
+    int invalidFilesCount = 0;
+
+    for (size_t i = 0; i < batch.results.size(); i++)
+    {
+        const PlayerValidation& result = batch.results[i];
+        bool hasIssues = result.playerIssues != NO_ISSUES;
+
+        printValidationIssues(result.fileName, 0, result.playerIssues);
+
+        for (size_t level = 0; level < MAX_LEVEL; level++)
+        {
+            hasIssues = hasIssues || result.gameIssues[level] != NO_ISSUES;
+            printValidationIssues(result.fileName, level + 1, result.gameIssues[level]);
+        }
+
+        invalidFilesCount += hasIssues;
+    }
+
+    std::cout << "Validated " << batch.results.size() << " player files using " << batch.workersCount << " threads, ";
+    std::cout << invalidFilesCount << " with issues" << std::endl;
+}
+
+// Writes a binary copy next to every text map, the game loads those instead of parsing the text
+void convertMaps()
+{
+    const char mapsDirPath[] = "../Maps";
+    const char textFiles[] = "*";
+    const int foldersCount = 3;
+    int convertedCount = 0;
+
+    for (int level = MIN_LEVEL; level <= MAX_LEVEL; level++)
+    {
+        char* strLevel = intToString(level);
+        const char* pattern[foldersCount] = { mapsDirPath, strLevel, textFiles };
+        char* patternPath = getFilePath(pattern, foldersCount, "txt");
+
+        WIN32_FIND_DATAA fileData;
+        HANDLE findHandle = FindFirstFileA(patternPath, &fileData);
+        delete[] patternPath;
+
+        if (findHandle == INVALID_HANDLE_VALUE)
+        {
+            delete[] strLevel;
+            continue;
+        }
+
+        do
+        {
+            char mapName[MAX_PATH];
+            strCopy(fileData.cFileName, mapName, 0);
+            *strrchr(mapName, '.') = '\0';
+
+            const char* mapPath[foldersCount] = { mapsDirPath, strLevel, mapName };
+            char* txtFilePath = getFilePath(mapPath, foldersCount, "txt");
+            char* binFilePath = getFilePath(mapPath, foldersCount, "bin");
+
+            std::ifstream mapFile(txtFilePath);
+            Game game = {};
+
+            if (readGame(game, mapFile) && writeBinaryMap(game, binFilePath))
+            {
+                std::cout << txtFilePath << " -> " << binFilePath << std::endl;
+                convertedCount++;
+            }
+            else
+            {
+                std::cout << txtFilePath << ": could not be converted" << std::endl;
+            }
+
+            delete[] txtFilePath;
+            delete[] binFilePath;
+        } while (FindNextFileA(findHandle, &fileData));
+
+        FindClose(findHandle);
+        delete[] strLevel;
+    }
+
+    std::cout << "Converted " << convertedCount << " maps" << std::endl;
+}
+
+void run()
+{
+    enableVirtualTerminal();
+    initRandom();
+    initPlayerStore();
+    MapCatalog catalog;
+    loadMapCatalog(catalog);
+    buildCatalogPaths(catalog);
+
+    PlayerIndex playerIndex;
+    loadPlayerIndex(playerIndex);
+
+    Player player = enterApp(playerIndex, catalog);
+    Leaderboard leaderboard;
+
+    while (selectMenuOption(player, leaderboard, playerIndex, catalog));
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1 && strCompare(argv[1], VALIDATE_PLAYERS_OPTION) == 0)
+    {
+        validateAllPlayers();
+        return 0;
+    }
+
+    if (argc > 1 && strCompare(argv[1], CONVERT_MAPS_OPTION) == 0)
+    {
+        convertMaps();
+        return 0;
+    }
+
     run();
 
     return 0;